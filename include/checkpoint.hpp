@@ -0,0 +1,140 @@
+#pragma once
+
+#include "psim.hpp"
+#include "mapped_file.hpp"
+#include <thread>
+
+// A checkpoint is everything a simulation needs to continue from a tick: the parameters, the seed,
+// the statistics, the terrain, the occupants and both animal lists. The random streams are keyed by
+// the seed and the tick, so there is no generator state beyond that.
+//
+// The file is a checkpoint_header followed by the planes and the animal columns, each starting at
+// a multiple of CHECKPOINT_ALIGNMENT bytes from the start of the file. The header holds where each
+// one starts, so a mapped file can be used in place.
+#define CHECKPOINT_ALIGNMENT 64
+
+struct checkpoint_species {
+	int32_t initial_count;
+	int32_t dead_per_year;
+	int32_t max_age;
+	int32_t breed_age;
+	float breed_probability;
+	float hunger_hungry;
+	float hunger_rate;
+	int32_t kill_by;
+	float kill_crowding;
+
+	// Statistics.
+	int32_t dead_from_hunger;
+	int32_t born;
+	int32_t dead_from_age;
+	int32_t dead_randomly;
+	float kill_chance;
+
+	uint64_t count;
+	uint64_t cells;     // Offsets of the columns, with count int32, float, uint8, int8 and int32 values.
+	uint64_t hunger;
+	uint64_t age;
+	uint64_t direction;
+	uint64_t birthday;
+};
+
+struct checkpoint_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t seed;
+	int32_t world_size;
+	int32_t ticks_per_year;
+	int32_t year;
+	int32_t ticks;
+	int32_t new_year;
+	int32_t seals_eaten_by_bears;
+	uint64_t terrain;   // Offsets of the planes, with world_size * world_size bytes each.
+	uint64_t occupants;
+	checkpoint_species bears;
+	checkpoint_species seals;
+};
+
+// A checkpoint file mapped into memory. Opening one only reads the header,
+// and the rest is paged in as the simulation copies it.
+class checkpoint {
+public:
+
+	checkpoint() = default;
+	checkpoint(const checkpoint&) = delete;
+	~checkpoint();
+
+	checkpoint& operator=(const checkpoint&) = delete;
+
+	// Returns false if the file could not be mapped, or is not a whole checkpoint.
+	bool open(const std::string& path);
+	void close();
+
+	bool is_open() const {
+		return data != nullptr;
+	}
+
+	const checkpoint_header& header() const {
+		return *(const checkpoint_header*)data;
+	}
+
+	// The parameters and the seed it was saved with.
+	sim_params params() const;
+	uint64_t seed() const;
+
+	sim_stats stats() const;
+	terrain_plane make_terrain() const;
+	const uint8_t* occupants() const;
+	void read_animals(const checkpoint_species& species, animal_list& list) const;
+
+private:
+
+	template<typename T>
+	const T* at(uint64_t offset) const {
+		return (const T*)(data + offset);
+	}
+
+	mapped_file file;
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+
+};
+
+// Writes checkpoints from a background thread. save() copies the state it needs before it returns,
+// so the simulation can go on while the file is written. The file is written next to the path
+// and renamed when it is complete, so a checkpoint is never seen half written.
+class checkpoint_writer {
+public:
+
+	checkpoint_writer() = default;
+	checkpoint_writer(const checkpoint_writer&) = delete;
+	~checkpoint_writer();
+
+	checkpoint_writer& operator=(const checkpoint_writer&) = delete;
+
+	// Waits for the last checkpoint to be written before starting on this one.
+	void save(const psim& sim, const std::string& path);
+
+	// Waits for the last checkpoint to be written. Returns false if it could not be written.
+	bool wait();
+
+	bool is_writing() const {
+		return writer.joinable();
+	}
+
+private:
+
+	void write();
+
+	std::thread writer;
+	std::string path;
+	bool ok = true;
+
+	// The state being written.
+	checkpoint_header header = {};
+	terrain_plane terrain;
+	std::vector<uint8_t> occupants;
+	animal_list bears;
+	animal_list seals;
+
+};
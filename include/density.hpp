@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <fstream>
+
+#define DENSITY_LEVELS              3
+#define DENSITY_BLOCK_SIZE(LEVEL)   (4 << (2 * (LEVEL))) // 4, 16 and 64 cells along each side. Each level is 4 by 4 blocks of the one before.
+
+// The cells of each kind in the blocks of one level, in rows of per_row blocks.
+// Blocks along the right and bottom edges are cut off by the world.
+struct density_level {
+	int block_size = 0;
+	int per_row = 0;
+	std::vector<uint16_t> bears;
+	std::vector<uint16_t> seals;
+	std::vector<uint16_t> open_water; // Water without an animal on it. The rest of a block is open ground.
+};
+
+// How many animals there are in the blocks of the world, at a few block sizes, like the mipmaps of a texture.
+// It is kept up to date by recounting the parts of the world that changed, so a zoomed out view can be drawn
+// from a level that is a fraction of the size of the world. Only the first level is counted from the cells,
+// and each level after it from the one before.
+class density_pyramid {
+public:
+
+	void resize(int world_size);
+
+	// Recounts the blocks of every level that overlap the square of size cells at (x, y),
+	// which must start on a block of the first level.
+	void recount(const uint8_t* occupants, const uint8_t* terrain, int x, int y, int size);
+
+	const density_level& level(int i) const {
+		return levels[i];
+	}
+
+	// The average colour of the cells in the block, as psim::pixel() would draw them.
+	uint32_t pixel(int level, int block) const;
+
+private:
+
+	int world_size = 0;
+	density_level levels[DENSITY_LEVELS];
+
+};
+
+// The bears and seals in square regions of the world, in rows of per_row regions.
+// Regions along the right and bottom edges are cut off by the world.
+struct region_grid {
+	int region_size = 0;
+	int per_row = 0;
+	std::vector<int> bears;
+	std::vector<int> seals;
+
+	void resize(int world_size, int region_size);
+
+	// Adds the counts of another grid of the same size, and resets them there.
+	void take(region_grid& other);
+};
+
+// A time series of region grids, as a raster of counts per frame.
+//
+// The header is "PSRG", then the version, the world size, the region size, the regions per row and the ticks
+// per year, as uint32. Each frame is the tick as uint32, followed by per_row * per_row bear counts and as many
+// seal counts, as uint16, a row of regions at a time.
+class region_writer {
+public:
+
+	region_writer() = default;
+	region_writer(const region_writer&) = delete;
+	~region_writer();
+
+	region_writer& operator=(const region_writer&) = delete;
+
+	bool open(const std::string& path, int world_size, const region_grid& grid, int ticks_per_year);
+	void close();
+
+	bool is_open() const {
+		return file.is_open();
+	}
+
+	void write(int tick, const region_grid& grid);
+
+	// The tick of the last frame written, or -1 if there is none.
+	int last_tick() const {
+		return written_tick;
+	}
+
+private:
+
+	std::ofstream file;
+	int written_tick = -1;
+	std::vector<uint16_t> counts;
+
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+
+#define EVENT_BIRTH				0
+#define EVENT_DEATH_RANDOM		1
+#define EVENT_DEATH_EATEN		2
+#define EVENT_DEATH_STARVED		3
+#define EVENT_DEATH_AGED		4
+
+#define EVENT_BLOCK_SIZE		4096
+
+// A block of events, stored column by column, which is also how it is written to the file.
+// The file starts with "PSEV" and a version, followed by the blocks. Each block is its count
+// followed by that many of each column. Events in a tick are not in any particular order.
+struct event_block {
+	uint32_t count = 0;
+	int32_t tick[EVENT_BLOCK_SIZE];
+	float hunger[EVENT_BLOCK_SIZE];
+	uint8_t type[EVENT_BLOCK_SIZE];
+	uint8_t animal[EVENT_BLOCK_SIZE];
+	uint8_t age[EVENT_BLOCK_SIZE];
+};
+
+// Writes blocks of events to a file from a background thread. The blocks are allocated when the log
+// is opened, so memory use does not grow with the length of a run. If the writer falls behind,
+// swap() waits for a block to be written.
+class event_log {
+public:
+
+	event_log() = default;
+	event_log(const event_log&) = delete;
+	~event_log();
+
+	event_log& operator=(const event_log&) = delete;
+
+	// Opens the file with enough blocks for the number of producers.
+	bool open(const std::string& path, int producers);
+
+	// Writes the submitted blocks and closes the file. Blocks that were taken must be submitted first.
+	void close();
+
+	bool is_open() const {
+		return writer.joinable();
+	}
+
+	// Returns an empty block.
+	event_block* take();
+
+	// Queues the block for writing, and returns an empty block.
+	event_block* swap(event_block* full);
+
+	// Queues the block for writing.
+	void submit(event_block* block);
+
+private:
+
+	void write_blocks();
+
+	std::ofstream file;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable queued_condition;
+	std::condition_variable free_condition;
+	std::vector<event_block> blocks;
+	std::vector<event_block*> queued;
+	std::vector<event_block*> free;
+	bool closing = false;
+
+};
+
+// Adds the events of one thread to a block, and hands it to the log when full.
+// Nothing is recorded if the stream has no block.
+struct event_stream {
+	event_log* log = nullptr;
+	event_block* block = nullptr;
+
+	void push(uint8_t type, uint8_t animal, uint8_t age, float hunger, int tick) {
+		if (!block) {
+			return;
+		}
+		const uint32_t i = block->count;
+		block->tick[i] = tick;
+		block->hunger[i] = hunger;
+		block->type[i] = type;
+		block->animal[i] = animal;
+		block->age[i] = age;
+		if (++block->count == EVENT_BLOCK_SIZE) {
+			block = log->swap(block);
+		}
+	}
+
+	void death(uint8_t reason, uint8_t age, float hunger, uint8_t animal, int tick) {
+		push(reason, animal, age, hunger, tick);
+	}
+
+	void birth(uint8_t animal, int tick) {
+		push(EVENT_BIRTH, animal, 0, 0.0f, tick);
+	}
+};
+
+// Calls read(block) for every block in an event log.
+// Returns false if the file could not be opened, is not an event log, or is truncated.
+bool read_event_log(const std::string& path, const std::function<void(const event_block&)>& read);
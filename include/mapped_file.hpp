@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read only into memory. Pages are read from the file as they are touched,
+// and files that were read recently are usually still in the page cache.
+class mapped_file {
+public:
+
+	mapped_file() = default;
+	mapped_file(const mapped_file&) = delete;
+	~mapped_file();
+
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	// Returns false if the file could not be opened, is empty, or could not be mapped.
+	bool open(const std::string& path);
+	void close();
+
+	bool is_open() const {
+		return bytes != nullptr;
+	}
+
+	const uint8_t* data() const {
+		return bytes;
+	}
+
+	size_t size() const {
+		return length;
+	}
+
+private:
+
+	const uint8_t* bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+
+};
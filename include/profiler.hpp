@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <chrono>
+
+// Set to 0 to compile the profiler out. The zones and counters then cost nothing.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+#define PROFILE_BUFFER_SIZE 65536 // Events kept per thread. Must be a power of two.
+
+// The parts of a tick and a frame that are timed.
+enum profile_zone : uint8_t {
+	ZONE_UPDATE,
+	ZONE_KILL,
+	ZONE_BUCKET,
+	ZONE_VITALS,
+	ZONE_BEARS,
+	ZONE_SEALS,
+	ZONE_TILES,       // One worker's share of a pass.
+	ZONE_FINISH_PASS,
+	ZONE_REPLAY,
+	ZONE_DRAW,
+	ZONE_UPLOAD,
+	ZONE_COUNT
+};
+
+enum profile_counter : uint8_t {
+	COUNTER_MOVES_TRIED,
+	COUNTER_MOVES,
+	COUNTER_HUNTS,
+	COUNTER_BIRTHS,
+	COUNTER_CELLS_PROBED, // A neighbour mask counts as one probe.
+	COUNTER_COUNT
+};
+
+const char* profile_zone_name(int zone);
+const char* profile_counter_name(int counter);
+
+// Counts of one tick. Each worker keeps its own, and they are added up after each pass.
+struct profile_counters {
+	uint64_t values[COUNTER_COUNT] = {};
+
+	// Adds the counts of another set, and resets them there.
+	void take(profile_counters& other);
+};
+
+// A zone that was timed, or the value of a counter after a tick.
+struct profile_event {
+	uint64_t time = 0;  // Nanoseconds since the profiler started.
+	uint64_t value = 0; // The duration of a zone, or the value of a counter.
+	uint8_t zone = 0;   // The zone, or ZONE_COUNT + counter.
+};
+
+// The events of one thread. Only the owning thread writes, and it never waits for a reader.
+// When the buffer is full, the oldest events are overwritten.
+struct profile_buffer {
+	std::unique_ptr<profile_event[]> events = std::make_unique<profile_event[]>(PROFILE_BUFFER_SIZE);
+	std::atomic<uint64_t> written = 0;
+	std::atomic<uint64_t> zone_totals[ZONE_COUNT] = {}; // Nanoseconds spent in each zone.
+	int thread = 0;
+
+	void push(const profile_event& event) {
+		const uint64_t i = written.load(std::memory_order_relaxed);
+		events[i & (PROFILE_BUFFER_SIZE - 1)] = event;
+		written.store(i + 1, std::memory_order_release);
+		if (event.zone < ZONE_COUNT) {
+			zone_totals[event.zone].store(zone_totals[event.zone].load(std::memory_order_relaxed) + event.value, std::memory_order_relaxed);
+		}
+	}
+
+	// Copies the events that are still in the buffer.
+	void read(std::vector<profile_event>& out) const;
+};
+
+// Collects the buffers of every thread that has recorded something.
+class profiler {
+public:
+
+	profiler();
+
+	uint64_t now() const {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// The calling thread's buffer, which is made the first time a thread asks for it.
+	profile_buffer& buffer();
+
+	void count(const profile_counters& counters);
+
+	// Milliseconds per call of summary() spent in each zone, smoothed over the last calls, followed by the counters.
+	std::string summary(const profile_counters& counters);
+
+	// Writes the events in the buffers in the Chrome trace format, which can be opened in chrome://tracing or Perfetto.
+	bool write_chrome_trace(const std::string& path);
+
+private:
+
+	std::chrono::steady_clock::time_point start;
+	std::mutex mutex;
+	std::vector<std::unique_ptr<profile_buffer>> buffers;
+	uint64_t last_totals[ZONE_COUNT] = {};
+	double average_ms[ZONE_COUNT] = {};
+
+};
+
+profiler& get_profiler();
+
+// Records the time from construction to destruction as an event of the zone.
+struct profile_scope {
+	uint64_t start;
+	uint8_t zone;
+
+	profile_scope(uint8_t zone) : start(get_profiler().now()), zone(zone) {
+
+	}
+
+	~profile_scope() {
+		profiler& profiler = get_profiler();
+		const uint64_t end = profiler.now();
+		profiler.buffer().push({ start, end - start, zone });
+	}
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_SCOPE(ZONE)					profile_scope profile_scope_timer(ZONE)
+#define PROFILE_COUNT(COUNTERS, COUNTER)	(COUNTERS).values[COUNTER]++
+#else
+#define PROFILE_SCOPE(ZONE)
+#define PROFILE_COUNT(COUNTERS, COUNTER)
+#endif
@@ -1,276 +1,383 @@
 #pragma once
 
-#include "assets.hpp"
-#include <timer.hpp>
-#include <graphics.hpp>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "workers.hpp"
+#include "rng.hpp"
+#include "scenario.hpp"
+#include "terrain.hpp"
+#include "event_log.hpp"
+#include "replay.hpp"
+#include "profiler.hpp"
+#include "tiled_plane.hpp"
+#include "density.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The world size inside the tick kernels. The kernels are instantiated for the power of two sizes,
+// where SIZE is the size and index arithmetic turns into shifts, and with SIZE = 0 for any other size.
+#define WORLD_SIZE    (SIZE ? SIZE : world_size)
+
+// Calls the instantiation of a kernel for the world size.
+#define DISPATCH(KERNEL, ...) switch (world_size) { \
+	case 256: KERNEL<256>(__VA_ARGS__); break; \
+	case 512: KERNEL<512>(__VA_ARGS__); break; \
+	case 1024: KERNEL<1024>(__VA_ARGS__); break; \
+	case 2048: KERNEL<2048>(__VA_ARGS__); break; \
+	case 4096: KERNEL<4096>(__VA_ARGS__); break; \
+	case 8192: KERNEL<8192>(__VA_ARGS__); break; \
+	default: KERNEL<0>(__VA_ARGS__); break; \
+	}
 
-#define WORLD_SIZE    2048
-#define TERRAIN_AT(I) textures.world.pixels[I]
+#define TERRAIN_AT(I) world[I]
+#define ANIMAL_AT(I)  occupants[I]
+#define PIXEL_AT(I)   (ANIMAL_AT(I) == ANIMAL_BEAR ? BEAR : ANIMAL_AT(I) == ANIMAL_SEAL ? SEAL : TERRAIN_AT(I) == TERRAIN_WATER ? WATER : GROUND)
 
+// Pixel colours, as found in the world map.
 #define BEAR     0xFFFFFF00
 #define SEAL     0xFFFF0000
 #define GROUND   0xFF338844
 #define WATER    0xFFC8EBFF
 #define ICE      0xFFEEEEEE
 
-#define TICKS_PER_YEAR				500
-#define RANDOM_DIRECTION			rng_direction(rng)
+// Values in the terrain plane.
+#define TERRAIN_GROUND 0
+#define TERRAIN_WATER  1
+
+// Values in the occupant plane.
+#define ANIMAL_NONE    0
+#define ANIMAL_BEAR    1
+#define ANIMAL_SEAL    2
+
+#define RANDOM_DIRECTION			worker.random.next_int(8)
 #define SWAP_AND_POP(V, I)			(V)[I] = (V).back(); (V).pop_back();
-#define SET_ANIMAL(V)				animals = &V; to_add = &V##_to_add; stats.animals = &stats.##V;
-#define MAX_TICKS_PER_DRAW			1
-#define SIM_AUTO					1
-
-struct cell_data {
-	int8 direction = 0;
-	uint8 age = 0;
-	float hunger = 0;
-	uint32 animal = 0;
+#define SET_ANIMAL(V)				animals = &V; species = &params.V; stats.animals = &stats.V; for (auto& worker : tick_workers) { worker.stats.animals = &worker.stats.V; }
+#define PARALLEL_TILE_SIZE			64
+#define SERIAL_PHASE_ANIMALS		512 // Phases with fewer animals are updated by the calling thread alone, since waking the workers costs more.
+#define VITALS_BLOCK				256 // Slots update_vitals() checks at a time, before it collects the ones that died.
+#define DIRTY_TILE_SIZE				32
+#define MAX_WORLD_SIZE				46340 // The largest world with a cell count that fits in an int.
+#define CAPACITY_HEADROOM			2     // Animals reserved for when the scenario does not set a capacity, per initial animal.
+#define MARK_DIRTY(TILES, I)		(TILES)[((I) % WORLD_SIZE) / DIRTY_TILE_SIZE + ((I) / WORLD_SIZE) / DIRTY_TILE_SIZE * dirty_tiles_per_row] = 1
+#define REGION_SIZE					64 // Cells along each side of the regions in psim::regions. At most 255, so a count fits the uint16 of region_writer.
+#define REGION_OF(I)				(((I) % WORLD_SIZE) / REGION_SIZE + ((I) / WORLD_SIZE) / REGION_SIZE * regions.per_row)
+#define REGION_COUNTS(GRID, ANIMAL)	((ANIMAL) == ANIMAL_BEAR ? (GRID).bears : (GRID).seals)
+#define BYTE_LANES(B)				(0x0101010101010101ull * (uint64_t)(B)) // The byte in each of the 8 bytes of a word.
+
+// Random streams. An animal's draws in a tick come from the stream keyed by (seed, stream, tick, cell).
+#define RANDOM_STREAM_SETUP			0 // Keyed by (seed, stream, species, 0) for the cells and (seed, stream, species, 1) for the rest.
+#define RANDOM_STREAM_BEARS			1
+#define RANDOM_STREAM_BEARS_BREED	2
+#define RANDOM_STREAM_SEALS			3
+#define RANDOM_STREAM_KILL			4 // Keyed by (seed, stream, tick, species) instead.
+
+#define KILL_MAX_TRIES				64 // Candidates drawn for a victim of kill() before the last one is taken anyway.
+#define KILL_MIN_WEIGHT				(1.0f / 32.0f) // Keeps the hunger weights of kill() from making a draw take forever.
+
+class checkpoint;
+
+// The bytes of the word that are 0, as one bit per byte. Used for neighbour masks, which hold a byte per direction.
+inline uint8_t zero_bytes(uint64_t bytes) {
+	const uint64_t high_bits = ~(((bytes & BYTE_LANES(0x7F)) + BYTE_LANES(0x7F)) | bytes | BYTE_LANES(0x7F));
+	return (uint8_t)(((high_bits >> 7) * 0x0102040810204080ull) >> 56);
+}
+
+// The direction of the lowest bit in a neighbour mask. The mask must not be 0.
+inline int lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+	unsigned long index = 0;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// The number of directions in a neighbour mask.
+inline int bit_count(uint32_t mask) {
+#ifdef _MSC_VER
+	return (int)__popcnt(mask);
+#else
+	return __builtin_popcount(mask);
+#endif
+}
+
+// Per-animal data of one species, stored densely by slot.
+// The slot of an animal is its index in these arrays. The slots of seals are kept in psim::seal_slots for their cells.
+struct animal_list {
+	std::vector<int> cells;
+	std::vector<float> hunger;
+	std::vector<uint8_t> age;
+	std::vector<int8_t> direction;
+	std::vector<int> birthday; // The tick of the year the animal gets a year older on.
+
+	size_t size() const {
+		return cells.size();
+	}
+
+	void push(int cell, uint8_t age, float hunger, int birthday);
+
+	// Adds an animal at each of the cells, all with the same age, hunger and birthday. Each array is resized once.
+	void append(const std::vector<int>& cells, uint8_t age, float hunger, int birthday);
+
+	// Makes room for at least count animals. Unlike std::vector::reserve, growing past the capacity
+	// at least doubles it, so a list that grows a little at a time is not copied every time.
+	void reserve(size_t count);
+
+	// Moves the last animal into the slot. The caller must update the slot of the moved animal's cell.
+	void swap_and_pop(int slot);
 };
 
 struct look_info {
-	ne::vector2i coord;
+	struct {
+		int x = 0;
+		int y = 0;
+	} coord;
 	int left_x = 0;
 	int top_y = 0;
 	int right_x = 0;
 	int bottom_y = 0;
 };
 
-#define LOG_ENABLED		0
-#if LOG_ENABLED
-#define LOG_DEATH_RANDOM  0
-#define LOG_DEATH_EATEN   1
-#define LOG_DEATH_STARVED 2
-#define LOG_DEATH_AGED    3
-struct sim_log {
-	struct log_death {
-		uint8 reason = 0;
-		uint8 age = 0;
-		float hunger = 0.0f;
-		uint32 animal = 0;
-		int tick = 0;
-	};
-	struct log_birth {
-		uint32 animal = 0;
-		int tick = 0;
-	};
-	std::vector<log_death> deaths;
-	std::vector<log_birth> births;
-	void death(uint8 reason, uint8 age, float hunger, uint32 animal, int tick) {
-		deaths.push_back({ reason, age, hunger, animal, tick });
-	}
-	void birth(uint32 animal, int tick) {
-		births.push_back({ animal, tick });
-	}
+struct sim_stats {
+	struct animal_stats {
+		int dead_from_hunger = 0;
+		int born = 0;
+		int dead_from_age = 0;
+		int dead_randomly = 0;
+
+		// Related to kill():
+		float kill_chance = 0.0f;
+
+		void add(const animal_stats& other);
+	} bears, seals;
+	animal_stats* animals = nullptr;
+	int seals_eaten_by_bears = 0;
+
+	// Adds the counters of another set of stats, and resets them there.
+	void take(sim_stats& other);
 };
-#endif
 
-// TODO: Make replay work properly.
-#define RECORD_ENABLED				0
-#define REPLAY_ENABLED				0
-#if RECORD_ENABLED || REPLAY_ENABLED
-#define LOAD_REPLAY					"stats/61885.re"
-#define GROUND_INDEX 0
-#define WATER_INDEX  1
-#define BEAR_INDEX   2
-#define SEAL_INDEX   3
-#define PIXEL_INDEX_TO_PIXEL(INDEX) [&]{\
-switch (INDEX) {\
-case GROUND_INDEX: return GROUND;\
-case WATER_INDEX: return WATER;\
-case BEAR_INDEX: return BEAR;\
-case SEAL_INDEX: return SEAL;\
-}}();
-#define PIXEL_TO_PIXEL_INDEX(PIXEL) [&]{\
-switch (PIXEL) {\
-case GROUND: return GROUND_INDEX;\
-case WATER: return WATER_INDEX;\
-case BEAR: return BEAR_INDEX;\
-case SEAL: return SEAL_INDEX;\
-}}();
-struct replay_tick {
-	struct cell {
-		uint32 index = 0; // 22 bits
-		uint32 pixel = 0; // 2 bits
-	};
-	std::vector<cell> cells;
+// Time spent in the phases of the ticks, in nanoseconds, while psim::timing is set. See bench.cpp.
+struct phase_timings {
+	uint64_t bears = 0; // update_bears(), without kill().
+	uint64_t seals = 0; // update_seals(), without kill().
+	uint64_t kill = 0;
 };
-struct replay_year {
-	replay_tick ticks[TICKS_PER_YEAR];
-	size_t current = 0;
-	void push(int tick, uint32 index, uint32 pixel) {
-		ticks[tick % TICKS_PER_YEAR].cells.push_back({ index, pixel });
-	}
-	replay_tick pop() {
-		return ticks[current++];
-	}
+
+// The time per call of the kernels that run inside the passes, from psim::time_kernels().
+struct kernel_timings {
+	double hunt = 0.0;
+	double breed = 0.0;
 };
-struct replay_simulation {
-	std::vector<replay_year> years;
-	void push(int year, int tick, uint32 index, uint32 pixel) {
-		while (year >= years.size()) {
-			years.push_back({});
+
+// Adds the time until the end of the scope to a total, unless the total is null.
+struct scoped_timer {
+	uint64_t* total;
+	std::chrono::steady_clock::time_point start;
+
+	scoped_timer(uint64_t* total) : total(total) {
+		if (total) {
+			start = std::chrono::steady_clock::now();
 		}
-		years[year].push(tick, index, pixel);
 	}
-	replay_tick pop() {
-		if (years.size() == 0) {
-			return {};
-		}
-		replay_tick tick = years[0].pop();
-		if (years[0].current >= TICKS_PER_YEAR) {
-			years.erase(years.begin());
+
+	~scoped_timer() {
+		if (total) {
+			*total += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
 		}
-		return tick;
 	}
 };
-#endif
 
-#define MODE_BALANCED				0
-#define MODE_BEARS_DIE				1
-#define MODE_BOTH_DIE				2
-#define MODE_STRESS_TEST			3
-#define SIM_MODE					MODE_BALANCED
-
-#if SIM_MODE == MODE_BALANCED
-
-#define INITIAL_BEAR_COUNT			1000
-#define BEARS_DEAD_PER_YEAR			50
-#define BEAR_MAX_AGE				30
-#define BEAR_BREED_AGE				5
-#define BEAR_BREED_PROBABILITY		0.3f
-#define BEAR_HUNGER_HUNGRY			0.4f
-#define BEAR_HUNGER_RATE			0.002f
-
-#define INITIAL_SEAL_COUNT			100000
-#define SEALS_DEAD_PER_YEAR			3000
-#define SEAL_MAX_AGE				20
-#define SEAL_BREED_AGE				3
-#define SEAL_BREED_PROBABILITY		0.15f
-#define SEAL_HUNGER_HUNGRY			0.2f
-#define SEAL_HUNGER_RATE			0.0005f
-
-#elif SIM_MODE == MODE_BEARS_DIE
-
-#define INITIAL_BEAR_COUNT			1000
-#define BEARS_DEAD_PER_YEAR			100
-#define BEAR_MAX_AGE				30
-#define BEAR_BREED_AGE				5
-#define BEAR_BREED_PROBABILITY		0.2f
-#define BEAR_HUNGER_HUNGRY			0.5f
-#define BEAR_HUNGER_RATE			0.002f
-
-#define INITIAL_SEAL_COUNT			100000
-#define SEALS_DEAD_PER_YEAR			3000
-#define SEAL_MAX_AGE				20
-#define SEAL_BREED_AGE				3
-#define SEAL_BREED_PROBABILITY		0.15f
-#define SEAL_HUNGER_HUNGRY			0.2f
-#define SEAL_HUNGER_RATE			0.0005f
-
-#elif SIM_MODE == MODE_BOTH_DIE
-
-#define INITIAL_BEAR_COUNT			1000
-#define BEARS_DEAD_PER_YEAR			50
-#define BEAR_MAX_AGE				30
-#define BEAR_BREED_AGE				5
-#define BEAR_BREED_PROBABILITY		0.5f
-#define BEAR_HUNGER_HUNGRY			0.4f
-#define BEAR_HUNGER_RATE			0.002f
-
-#define INITIAL_SEAL_COUNT			100000
-#define SEALS_DEAD_PER_YEAR			5000
-#define SEAL_MAX_AGE				20
-#define SEAL_BREED_AGE				3
-#define SEAL_BREED_PROBABILITY		0.1f
-#define SEAL_HUNGER_HUNGRY			0.2f
-#define SEAL_HUNGER_RATE			0.0005f
-
-#elif SIM_MODE == MODE_STRESS_TEST
-
-#define INITIAL_BEAR_COUNT			10000
-#define BEARS_DEAD_PER_YEAR			50
-#define BEAR_MAX_AGE				30
-#define BEAR_BREED_AGE				5
-#define BEAR_BREED_PROBABILITY		0.3f
-#define BEAR_HUNGER_HUNGRY			0.4f
-#define BEAR_HUNGER_RATE			0.002f
-
-#define INITIAL_SEAL_COUNT			1000000
-#define SEALS_DEAD_PER_YEAR			3000
-#define SEAL_MAX_AGE				20
-#define SEAL_BREED_AGE				3
-#define SEAL_BREED_PROBABILITY		0.15f
-#define SEAL_HUNGER_HUNGRY			0.2f
-#define SEAL_HUNGER_RATE			0.0005f
+#define TIME_SCOPE(TOTAL)			scoped_timer scope_timer(timing ? &(TOTAL) : nullptr)
+
+// State owned by one thread during a tick.
+struct tick_worker {
+	random_stream random;        // The stream of the animal being updated.
+	sim_stats stats;
+	std::vector<int> born;       // Cells of animals born, added after the pass.
+	std::vector<int> dead_bears; // Slots of bears that died, removed after the pass.
+	std::vector<int> dead_seals; // Slots of seals that died, removed after the pass.
+	std::vector<uint8_t> dirty_tiles;
+	event_stream events;
+	profile_counters counters;
+	region_grid regions;         // Animals added to and removed from each region, added to psim::regions after the pass.
+	bool ran = false;            // Took part in the pass, so finish_pass() has something to collect.
+};
 
-#endif
+// Scratch arrays used while updating the animals. They are cleared rather than freed between passes,
+// so after the first few ticks, a tick does not allocate.
+struct tick_scratch {
+	std::vector<int> dead_bears; // The slots of every worker, merged by finish_pass().
+	std::vector<int> dead_seals;
+	std::vector<int> born;
+	std::vector<int> next_slot;  // Where bucket() puts the next animal in each tile.
+};
 
+// The simulation itself. It has no knowledge of the engine, so it can be run
+// headless (see cli.cpp) as well as inside the viewer (see view.hpp).
+//
+// Animals are updated tile by tile. The tiles are split in four phases like a checkerboard,
+// so two tiles in the same phase are always a full tile apart. Everything an animal can touch
+// in a tick is within two cells of where it started, so the tiles of a phase can be updated
+// by different threads without locks. Deaths and births are applied after each pass.
+// Before a species is updated by tile, update_vitals() adds its hunger and age and removes the animals
+// that starved or died of age, so the tiles only see the survivors.
+// Random draws are keyed by the animal's cell rather than taken from a per-thread generator,
+// so the order tiles are picked up in does not matter either.
 struct psim {
 
-	ne::texture ani;
+	sim_params params;
+	species_params* species = nullptr; // The parameters of the animals being updated.
+	sim_stats stats;
 
-	struct {
-		struct animal_stats {
-			int dead_from_hunger = 0;
-			int born = 0;
-			int dead_from_age = 0;
-			int dead_randomly = 0;
-
-			// Related to kill():
-			float kill_chance = 0.0f;
-		} bears, seals;
-		animal_stats* animals = nullptr;
-		int seals_eaten_by_bears = 0;
-	} stats;
-
-#if LOG_ENABLED
-	sim_log log;
-#endif
+	// Births and deaths are written here while it is open.
+	event_log events;
+
+	// The world is recorded here after every tick while it is open.
+	replay_writer replay;
+
+	// Measures the phases of the ticks while set.
+	bool timing = false;
+	phase_timings timings;
+
+	// What happened in the last tick, if the profiler is enabled.
+	profile_counters counters;
 
 	int year = 0;
 	int ticks = 0;
+	int year_tick = 0; // The tick of the year. Animals with it as their birthday get older in this tick.
 	bool new_year = false;
 
-	std::vector<cell_data> cells;
-	std::vector<int> seals;
-	std::vector<int> bears;
-	std::vector<int>* animals = nullptr;
+	// The world is stored as planes of world_size * world_size, so neighbour probes only touch the bytes they need.
+	// Cells are indexed with int, which holds up to MAX_WORLD_SIZE * MAX_WORLD_SIZE.
+	int world_size = 0;
+	terrain_plane terrain;
+	const uint8_t* world = nullptr; // The terrain plane.
+	std::vector<uint8_t> occupants; // ANIMAL_NONE, ANIMAL_BEAR or ANIMAL_SEAL.
+	tiled_plane<int> seal_slots;    // Slot of the seal in seals, for hunt(). Only valid where there is a seal.
 
-	std::vector<int> seals_to_add;
-	std::vector<int> bears_to_add;
-	std::vector<int>* to_add = nullptr;
+	animal_list seals;
+	animal_list bears;
+	animal_list* animals = nullptr;
 
-	struct {
-		int ref_i = -1;
-		std::vector<int>* refs = nullptr;
-		ne::transform3f transform;
-		ne::font_text info;
-	} bb;
+	uint64_t seed = 0;
+	worker_pool workers;
+	std::vector<tick_worker> tick_workers;
+
+	int tiles_per_row = 0;
+	std::vector<int> tile_of_coord;  // The tile row or column of each x or y.
+	std::vector<int> phase_tiles[4]; // The tiles in each phase.
+	std::vector<int> active_tiles[4]; // The tiles in each phase with animals in the last bucket().
+	int phase_animals[4] = {};        // The animals in each phase in the last bucket().
+	std::vector<int> tile_offsets;   // Where each tile's animals start in tile_slots.
+	std::vector<int> tile_slots;     // Slots of the animals being updated, grouped by tile.
+	tick_scratch scratch;
+
+	// The bears and seals in each region of REGION_SIZE, at any tick. Kept up to date as animals move, are born and die.
+	region_grid regions;
+
+	// The regions are written here at the start of every year while it is open, and when it is closed.
+	region_writer region_log;
+
+	// Tiles of DIRTY_TILE_SIZE where an occupant has changed. Set by the simulation, and cleared by whoever
+	// consumes them, such as the viewer when uploading the changed parts of the world.
+	int dirty_tiles_per_row = 0;
+	std::vector<uint8_t> dirty_tiles;
+	std::vector<uint8_t> tick_dirty_tiles; // The tiles changed by the current tick, added to dirty_tiles when it ends.
+
+	// world_pixels must hold world_size * world_size pixels.
+	// The result of a run only depends on the parameters and the seed, not on the number of threads.
+	psim(const uint32_t* world_pixels, int world_size, const sim_params& params, uint64_t seed, int threads = 1);
+	psim(terrain_plane terrain, int world_size, const sim_params& params, uint64_t seed, int threads = 1);
+
+	// Places the initial animals on the cells, which must be the cells of the terrain plane, such as from
+	// the terrain cache. The lists are shuffled in place to draw the cells, and dropped afterwards.
+	psim(terrain_plane terrain, terrain_cells cells, int world_size, const sim_params& params, uint64_t seed, int threads = 1);
 
-	psim();
+	// Continues from a checkpoint, with the parameters and seed it was saved with.
+	psim(const checkpoint& from, int threads = 1);
+
+	// Forks a run from a checkpoint. The parameters and the seed may differ from the ones it was saved with.
+	// The terrain must be the checkpoint's, and can be shared by every fork.
+	psim(const checkpoint& from, terrain_plane terrain, const sim_params& params, uint64_t seed, int threads = 1);
+
+	~psim();
+
+	// Sets up the tiles, the workers and empty planes for the world size. Called by the constructors.
+	void init();
+
+	// Reserves memory for the capacity of each species in the scenario, capped by the cells in the world.
+	void plan_capacity();
+
+	// Places the initial animals of a species on distinct cells drawn from the candidates, with a random
+	// age, hunger and birthday. Places as many as there are candidates if the species wants more.
+	void place_animals(animal_list& list, uint8_t animal, const species_params& species, std::vector<int>& candidates);
+
+	// Starts writing births and deaths to the file. Returns false if it could not be opened.
+	bool open_event_log(const std::string& path);
+	void close_event_log();
+
+	// Starts recording the world after every tick, with a keyframe every keyframe_interval ticks,
+	// or every year if it is 0. Returns false if the file could not be opened.
+	bool open_replay(const std::string& path, int keyframe_interval = 0);
+	void close_replay();
+
+	// Starts writing the regions every year, from now. Returns false if the file could not be opened.
+	bool open_region_log(const std::string& path);
+	void close_region_log();
+
+	// Counts the animals in each region from scratch. Called by the constructors.
+	void count_regions();
 
 	void update();
-	void draw();
-
-	void update_bears();
-	void update_seals();
-
-	void look(int index, look_info& info);
-	bool try_move(int ref_i, int x, int y, uint32 terrain);
-	bool move(int ref_i, look_info& info, uint32 terrain, int direction);
-	bool try_birth(int cell_i, int x, int y, uint32 terrain);
-	int can_breed(float chance, int amount);
-	void breed(int cell_i, look_info& info, int amount, uint32 terrain);
-	bool try_hunt(int cell_i, int x, int y);
-	bool hunt(int cell_i, look_info& info);
-	
-	void kill(int per_year);
-
-	std::mt19937_64 rng;
-	std::uniform_int_distribution<int> rng_direction;
-
-#if RECORD_ENABLED || REPLAY_ENABLED
-	replay_simulation replay;
-#endif
+
+	// Times look() and hunt() for every bear, and look() and breed() for every animal, where they are now.
+	// The world is put back as it was afterwards. The kernels are timed in batches rather than call by call,
+	// since a call takes less time than reading the clock. Used by psim_bench.
+	kernel_timings time_kernels();
+
+	uint32_t pixel(int index) const {
+		return PIXEL_AT(index);
+	}
+
+	// The tick kernels. See WORLD_SIZE.
+	template<int SIZE> void tick();
+	template<int SIZE> void update_bears();
+	template<int SIZE> void update_seals();
+
+	template<int SIZE> void update_vitals();
+	template<int SIZE> void update_bear(tick_worker& worker, int ref_i);
+	template<int SIZE> void breed_bear(tick_worker& worker, int ref_i);
+	template<int SIZE> void update_seal(tick_worker& worker, int ref_i);
+
+	template<int SIZE> void bucket(const animal_list& list);
+	template<typename Update>
+	void for_each_animal(Update update);
+	void finish_pass();
+
+	template<int SIZE> void look(int index, look_info& info);
+	template<int SIZE> int neighbour(const look_info& info, int direction) const;
+	template<int SIZE> uint64_t gather(const uint8_t* plane, const look_info& info) const;
+	template<int SIZE> uint8_t free_neighbours(const look_info& info, uint8_t terrain) const;
+	template<int SIZE> uint8_t animal_neighbours(const look_info& info, uint8_t animal) const;
+	template<int SIZE> bool try_move(tick_worker& worker, int ref_i, int x, int y, uint8_t terrain);
+	template<int SIZE> bool move(tick_worker& worker, int ref_i, look_info& info, uint8_t terrain, int direction);
+	template<int SIZE> void give_birth(tick_worker& worker, int cell_i, int birth_index);
+	int can_breed(tick_worker& worker, float chance, int amount);
+	template<int SIZE> void breed(tick_worker& worker, int cell_i, look_info& info, int amount, uint8_t terrain);
+	template<int SIZE> void eat(tick_worker& worker, int ref_i, int hunt_index);
+	template<int SIZE> bool hunt(tick_worker& worker, int ref_i, look_info& info);
+
+	template<int SIZE> void bury(tick_worker& worker, animal_list& list, int ref_i);
+	void release(animal_list& list, int ref_i);
+	template<int SIZE> void remove(animal_list& list, int ref_i);
+	template<int SIZE> float kill_weight(int ref_i);
+	template<int SIZE> void kill();
+	template<int SIZE> kernel_timings time_kernels();
 
 };
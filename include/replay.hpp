@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+
+// A replay records the occupant plane after every tick.
+//
+// The header is "PSRP", the version, the world size, the ticks per year and the keyframe interval,
+// followed by the terrain with one bit per cell (set for water). Then there is one frame per tick.
+// Every keyframe_interval ticks it is a keyframe with every occupied cell, otherwise it is a delta
+// with the cells that changed during the tick. A cell appears once per frame, with its final occupant.
+//
+// A frame is its type (byte), tick (varint) and payload size (varint), followed by the payload.
+// The payload is the number of cells (varint), then for every cell in increasing order,
+// (distance from the previous cell << 2 | occupant) as a varint.
+//
+// Closing a replay appends an index of the keyframes, so a reader can seek straight to one.
+// If the index is missing because the recording was cut short, the reader scans the frames instead.
+class replay_writer {
+public:
+
+	replay_writer() = default;
+	replay_writer(const replay_writer&) = delete;
+	~replay_writer();
+
+	replay_writer& operator=(const replay_writer&) = delete;
+
+	// The terrain holds a byte per cell, which is 1 for water.
+	bool open(const std::string& path, int world_size, int ticks_per_year, int keyframe_interval, const uint8_t* terrain);
+	void close();
+
+	bool is_open() const {
+		return file.is_open();
+	}
+
+	// Records the occupants after the tick. Only the cells in dirty tiles are compared to the last frame,
+	// so every cell that changed since then must be in a dirty tile. The first frame is always a keyframe.
+	void write(int tick, const uint8_t* occupants, const std::vector<uint8_t>& dirty_tiles, int dirty_tiles_per_row, int dirty_tile_size);
+
+private:
+
+	void write_frame(uint8_t type, int tick);
+
+	std::ofstream file;
+	uint64_t offset = 0;
+	int world_size = 0;
+	int keyframe_interval = 0;
+	bool has_frame = false;
+	std::vector<uint8_t> previous;
+	std::vector<uint64_t> cells;
+	std::vector<uint8_t> payload;
+	std::vector<std::pair<int, uint64_t>> keyframes; // Tick and offset of each keyframe.
+
+};
+
+class replay_reader {
+public:
+
+	int world_size = 0;
+	int ticks_per_year = 0;
+	int keyframe_interval = 0;
+	std::vector<uint8_t> terrain; // A byte per cell, which is 1 for water.
+
+	bool open(const std::string& path);
+
+	// The tick of the last frame read, or -1 if none has been read.
+	int tick() const {
+		return current_tick;
+	}
+
+	int first_tick() const;
+	int last_tick() const;
+
+	// Applies the next frame to the occupants, and adds the cells that changed to changed.
+	// Returns false at the end of the replay.
+	bool next(std::vector<uint8_t>& occupants, std::vector<uint64_t>& changed);
+
+	// Reads the occupants as they were after the tick, starting from the closest keyframe before it.
+	// Returns false if the tick is not in the replay.
+	bool seek(int tick, std::vector<uint8_t>& occupants);
+
+private:
+
+	bool read_frame_header(uint8_t& type, int& tick, uint64_t& size);
+	bool read_payload(uint64_t size);
+	void apply_payload(std::vector<uint8_t>& occupants, std::vector<uint64_t>* changed);
+
+	std::ifstream file;
+	uint64_t frames_end = 0;
+	int current_tick = -1;
+	int final_tick = -1;
+	std::vector<uint8_t> payload;
+	std::vector<std::pair<int, uint64_t>> keyframes;
+
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// A counter based random number generator. Every draw is a hash of a key and a counter, so a stream can be
+// created for any (tick, animal) on the spot, and what it draws does not depend on which thread asks for it,
+// or in which order. The hash is the SplitMix64 finaliser.
+struct random_stream {
+
+	uint64_t key = 0;
+	uint64_t counter = 0;
+
+	static uint64_t mix(uint64_t value) {
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+
+	random_stream() = default;
+
+	random_stream(uint64_t seed, uint64_t stream, uint64_t tick = 0, uint64_t id = 0) {
+		key = mix(seed + 0x9E3779B97F4A7C15ull);
+		key = mix(key ^ (stream + 0x9E3779B97F4A7C15ull));
+		key = mix(key ^ (tick + 0x9E3779B97F4A7C15ull));
+		key = mix(key ^ (id + 0x9E3779B97F4A7C15ull));
+	}
+
+	uint64_t at(uint64_t index) const {
+		return mix(key + index * 0x9E3779B97F4A7C15ull);
+	}
+
+	uint64_t next() {
+		return at(counter++);
+	}
+
+	// Uniform in [0, count). Uses a multiply instead of a division, with a bias below 2^-32.
+	int next_int(int count) {
+		return (int)(((next() >> 32) * (uint64_t)count) >> 32);
+	}
+
+	// Uniform in [0, 1).
+	float next_float() {
+		return (float)(next() >> 40) * (1.0f / 16777216.0f);
+	}
+
+	float next_float(float min, float max) {
+		return min + next_float() * (max - min);
+	}
+
+	bool chance(float probability) {
+		return next_float() < probability;
+	}
+
+	// Batched draws. Each value only depends on its counter, so these loops vectorise.
+	void fill_ints(int* out, size_t count, int bound) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = (int)(((at(counter + i) >> 32) * (uint64_t)bound) >> 32);
+		}
+		counter += count;
+	}
+
+	void fill_floats(float* out, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = (float)(at(counter + i) >> 40) * (1.0f / 16777216.0f);
+		}
+		counter += count;
+	}
+
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "psim.hpp"
+#include "density.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#define SNAPSHOT_SLOTS 3
+
+// An animal picked out in the viewer, as it was when the snapshot was taken.
+struct followed_animal {
+	uint8_t animal = ANIMAL_NONE; // What was asked for with sim_runner::follow().
+	int slot = -1;
+	bool found = false;
+	int cell = 0;
+	float hunger = 0.0f;
+	uint8_t age = 0;
+};
+
+// The state of the simulation after a tick, as the renderer sees it.
+struct sim_snapshot {
+	std::vector<uint8_t> occupants;
+	density_pyramid density;
+	bool density_counted = false; // The density is up to date. See sim_runner::set_density().
+	std::vector<uint8_t> changed_since[SNAPSHOT_SLOTS]; // Dirty tiles since the snapshot in each slot was taken.
+	int ticks = 0;
+	int year = 0;
+	size_t bears = 0;
+	size_t seals = 0;
+	sim_stats stats;
+	profile_counters counters;
+	followed_animal followed;
+};
+
+// Runs a simulation on its own thread, as fast as it can or at a fixed number of ticks per second.
+//
+// After a tick, the runner copies the tiles that changed into a snapshot, and hands it to the renderer
+// through a triple buffer: the runner fills one slot, the renderer reads another, and the third holds the
+// latest one that was handed over. Only an atomic exchange passes slots between them, so neither ever waits
+// for the other. If the renderer has not taken the last snapshot yet, the runner does not copy another.
+//
+// Anything else that touches the simulation from another thread must do so through paused().
+class sim_runner {
+public:
+
+	sim_runner(psim& sim);
+	sim_runner(const sim_runner&) = delete;
+	~sim_runner();
+
+	sim_runner& operator=(const sim_runner&) = delete;
+
+	// Starts or pauses the ticks. Pausing waits for the current tick to finish.
+	void set_running(bool running);
+
+	bool is_running() const {
+		return running.load(std::memory_order_acquire);
+	}
+
+	// Ticks per second, or 0 to tick as fast as possible.
+	void set_rate(int ticks_per_second);
+
+	// Pauses the simulation while calling edit, and continues it afterwards if it was running.
+	void paused(const std::function<void()>& edit);
+
+	// Copies the simulation into a snapshot and hands it over. The runner does this after each tick,
+	// and others may only do it while paused, such as after changing the world.
+	void publish();
+
+	// Takes the latest snapshot. Returns false if there is none newer than the last one taken.
+	bool acquire();
+
+	// The snapshot taken last.
+	const sim_snapshot& front() const {
+		return slots[front_slot];
+	}
+
+	// The tiles that differ between the snapshot taken last and the one before it.
+	const std::vector<uint8_t>& changed() const {
+		return front().changed_since[previous_front_slot];
+	}
+
+	// Picks out an animal by its slot in the list of the species, or stops following if it is ANIMAL_NONE.
+	void follow(uint8_t animal, int slot);
+
+	// Keeps the density pyramid of the snapshots up to date while set, by recounting the tiles that changed.
+	// That costs about as much as copying them, so the renderer only asks for it while it draws from it.
+	void set_density(bool counting) {
+		count_density = counting;
+	}
+
+private:
+
+	void run();
+	void collect_dirty_tiles();
+
+	psim& sim;
+	sim_snapshot slots[SNAPSHOT_SLOTS];
+	std::vector<uint8_t> changed_since[SNAPSHOT_SLOTS]; // Tiles where each slot differs from the simulation.
+	std::vector<uint8_t> uncounted[SNAPSHOT_SLOTS];     // Tiles where the density of each slot is out of date.
+
+	// Owned by the runner, the renderer and neither. The exchanged value has SNAPSHOT_FRESH set
+	// if it has not been taken since it was handed over.
+	int back_slot = 0;
+	int front_slot = 1;
+	int previous_front_slot = 1;
+	std::atomic<int> middle_slot = 2;
+
+	std::atomic<bool> running = false;
+	std::atomic<int> rate = 0;
+	std::atomic<int> follow_animal = ANIMAL_NONE;
+	std::atomic<int> follow_slot = -1;
+	std::atomic<bool> count_density = false;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable run_condition;
+	std::condition_variable idle_condition;
+	bool idle = false;
+	bool stopping = false;
+	bool unpublished = false; // The last tick was not handed over, since the renderer had not taken the one before.
+
+};
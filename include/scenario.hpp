@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+
+// How kill() picks the animals that die at random.
+#define KILL_UNIFORM 0 // Every animal is as likely.
+#define KILL_AGE     1 // In proportion to the age.
+#define KILL_HUNGER  2 // In proportion to the hunger.
+
+// Parameters of one species.
+struct species_params {
+	int initial_count = 0;
+	int dead_per_year = 0;       // Animals removed at random each year.
+	int max_age = 0;
+	int breed_age = 0;
+	float breed_probability = 0.0f;
+	float hunger_hungry = 0.0f;  // Above this, the animal goes looking for food.
+	float hunger_rate = 0.0f;    // Added to the hunger every tick.
+	int kill_by = KILL_UNIFORM;  // "uniform", "age" or "hunger" in a scenario file.
+	float kill_crowding = 0.0f;  // How much more likely an animal surrounded by its own species is to be killed, as in 1 + kill_crowding.
+	int capacity = 0;            // Animals to reserve memory for up front, or 0 for CAPACITY_HEADROOM times the initial count.
+};
+
+// Everything that describes a run, except the world map and the seed.
+// The defaults are the balanced preset.
+struct sim_params {
+	int ticks_per_year = 500;
+	species_params bears = { 1000, 50, 30, 5, 0.3f, 0.4f, 0.002f };
+	species_params seals = { 100000, 3000, 20, 3, 0.15f, 0.2f, 0.0005f };
+};
+
+// The presets are "balanced", "bears_die", "both_die" and "stress_test".
+// Returns false if there is no preset with the name.
+bool find_preset(const std::string& name, sim_params& params);
+
+// Sets one parameter, where the key is as in a scenario file, prefixed by "bears." or "seals." for the species.
+// Returns false if the key is unknown or the value can not be parsed.
+bool set_param(sim_params& params, const std::string& key, const std::string& value);
+
+bool are_params_valid(const sim_params& params);
+
+// Loads a scenario file. A scenario is an INI file, where keys outside a section set the run itself,
+// and keys in the [bears] and [seals] sections set the species. A scenario may start with
+// "preset = <name>" to only override some parameters of a preset. Lines starting with # or ; are ignored.
+// Returns false and describes the problem in error if the file could not be read or has an unknown key.
+bool load_scenario(const std::string& path, sim_params& params, std::string& error);
+
+// Loads the scenario if the name is not a preset.
+bool load_scenario_or_preset(const std::string& name, sim_params& params, std::string& error);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <memory>
+
+// Loads a square world map, either from a PNG image or from a raw map.
+// A raw map (.raw) is one byte per cell, row by row, where 0 is water and
+// anything else is ground. The pixels are in the same format as the world texture.
+// Returns false if the file could not be read, or the map is not square or larger than MAX_WORLD_SIZE.
+bool load_terrain(const std::string& path, std::vector<uint32_t>& pixels, int& size);
+
+// The terrain plane of a world map, with TERRAIN_GROUND or TERRAIN_WATER for every cell.
+// A simulation never writes to it, so many simulations can share one.
+using terrain_plane = std::shared_ptr<const std::vector<uint8_t>>;
+
+terrain_plane make_terrain_plane(const uint32_t* pixels, int size);
+
+// The cells of each terrain in a plane, in order. The initial animals are drawn from these,
+// so placing them does not have to look for cells of the right terrain.
+struct terrain_cells {
+	std::vector<int> ground;
+	std::vector<int> water;
+};
+
+terrain_cells make_terrain_cells(const std::vector<uint8_t>& plane);
+
+// Loads a world map through the terrain cache next to it, at path + ".pstc". The cache holds the plane and
+// the cells of each terrain. It is mapped into memory and copied out, which is far faster than decoding
+// the map, and the cell lists are checked as they are copied. The cell lists are copied because seeding
+// shuffles them. The cache is made from the map when it is missing, when the map has changed since, or when
+// it does not check out. A cache that can not be written is left out.
+// Returns false if neither could be read.
+bool load_cached_terrain(const std::string& path, terrain_plane& plane, terrain_cells& cells, int& size);
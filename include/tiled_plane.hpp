@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#define PLANE_TILE_SIZE 64 // Cells along each side of a tile in a tiled_plane. Must be a power of two.
+
+// A value for every cell of the world, stored in square tiles that are only allocated when a value in them
+// is first set. Tiles that were never written take no memory and read as the fill value, so a plane that is
+// empty over large parts of the world, such as the seal slots over land, only costs memory where it is used.
+// Tiles can be allocated by several threads at once, but two threads must not write the same cell.
+template<typename T>
+class tiled_plane {
+public:
+
+	tiled_plane() = default;
+	tiled_plane(const tiled_plane&) = delete;
+
+	~tiled_plane() {
+		clear();
+	}
+
+	tiled_plane& operator=(const tiled_plane&) = delete;
+
+	// Frees every tile.
+	void resize(int world_size, T fill) {
+		clear();
+		this->world_size = world_size;
+		this->fill = fill;
+		tiles_per_row = (world_size + PLANE_TILE_SIZE - 1) / PLANE_TILE_SIZE;
+		tile_count = (size_t)tiles_per_row * (size_t)tiles_per_row;
+		tiles = std::make_unique<std::atomic<T*>[]>(tile_count);
+	}
+
+	void clear() {
+		for (size_t i = 0; i < tile_count; i++) {
+			delete[] tiles[i].exchange(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	T get(int x, int y) const {
+		const T* data = tiles[tile_of(x, y)].load(std::memory_order_acquire);
+		return data ? data[cell_in_tile(x, y)] : fill;
+	}
+
+	void set(int x, int y, T value) {
+		std::atomic<T*>& tile = tiles[tile_of(x, y)];
+		T* data = tile.load(std::memory_order_acquire);
+		if (!data) {
+			T* allocated = new T[PLANE_TILE_SIZE * PLANE_TILE_SIZE];
+			std::fill(allocated, allocated + PLANE_TILE_SIZE * PLANE_TILE_SIZE, fill);
+			if (tile.compare_exchange_strong(data, allocated, std::memory_order_acq_rel)) {
+				data = allocated;
+			} else {
+				delete[] allocated; // Another thread got there first, and data is its tile.
+			}
+		}
+		data[cell_in_tile(x, y)] = value;
+	}
+
+	T get(size_t index) const {
+		return get((int)(index % world_size), (int)(index / world_size));
+	}
+
+	void set(size_t index, T value) {
+		set((int)(index % world_size), (int)(index / world_size), value);
+	}
+
+	size_t allocated_bytes() const {
+		size_t allocated = 0;
+		for (size_t i = 0; i < tile_count; i++) {
+			allocated += (tiles[i].load(std::memory_order_relaxed) ? 1 : 0);
+		}
+		return allocated * PLANE_TILE_SIZE * PLANE_TILE_SIZE * sizeof(T);
+	}
+
+private:
+
+	size_t tile_of(int x, int y) const {
+		return (unsigned)x / PLANE_TILE_SIZE + (size_t)((unsigned)y / PLANE_TILE_SIZE) * tiles_per_row;
+	}
+
+	static size_t cell_in_tile(int x, int y) {
+		return ((unsigned)x & (PLANE_TILE_SIZE - 1)) + ((unsigned)y & (PLANE_TILE_SIZE - 1)) * PLANE_TILE_SIZE;
+	}
+
+	int world_size = 0;
+	int tiles_per_row = 0;
+	size_t tile_count = 0;
+	T fill = {};
+	std::unique_ptr<std::atomic<T*>[]> tiles;
+
+};
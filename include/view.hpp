@@ -0,0 +1,66 @@
+#pragma once
+
+#include "psim.hpp"
+#include "checkpoint.hpp"
+#include "runner.hpp"
+#include <graphics.hpp>
+
+#define SIM_TICKS_PER_SECOND		0 // 0 to tick as fast as possible, independent of the frame rate.
+#define SIM_AUTO					1
+#define SIM_SCENARIO				"assets/scenarios/balanced.ini"
+#define LOAD_REPLAY					"stats/replay.psrp"
+#define SIM_RESUME					0 // Continue from LOAD_CHECKPOINT instead of starting over.
+#define LOAD_CHECKPOINT				"stats/checkpoint.pscp"
+#define SIM_OVERVIEW				1 // Draw the density pyramid instead of the world when a pixel covers a whole block.
+
+// Draws a psim with the engine. All rendering state lives here, so the
+// simulation itself never touches a texture. The simulation runs on its own thread,
+// and is drawn from the snapshots it hands over.
+struct psim_view {
+
+	psim& sim;
+	ne::texture ani;
+	ne::texture overview[DENSITY_LEVELS]; // A texel per block of each level of the density pyramid.
+	uint32_t pixel_buffer = 0; // Streams changed pixels to the textures, if supported.
+
+	// Dirty tiles that have not been uploaded yet, to ani first and then to each overview.
+	// Only what is in view of the texture being drawn is uploaded, and the rest waits until it is.
+	std::vector<uint8_t> stale[DENSITY_LEVELS + 1];
+
+	struct {
+		uint8_t animal = ANIMAL_NONE;
+		int ref_i = -1;
+		ne::transform3f transform;
+		ne::font_text info;
+	} bb;
+
+	replay_reader replay;
+	bool playing = false; // Showing the replay instead of the simulation.
+
+	checkpoint_writer checkpoints;
+
+	sim_runner runner; // Last, so the thread stops before anything it uses is destroyed.
+
+	psim_view(psim& sim);
+	psim_view(const psim_view&) = delete;
+	~psim_view();
+
+	psim_view& operator=(const psim_view&) = delete;
+
+	void update();
+	void draw();
+
+	// The level of the density pyramid to draw at the camera's zoom, or -1 for the world itself.
+	int overview_level() const;
+
+	// Takes the latest snapshot, and uploads what is stale and in view of the texture for the level.
+	// The world is drawn instead while the snapshot has no density counted. Returns the level to draw, with its texture bound.
+	int upload_dirty_tiles(int level);
+
+	// Picks out an animal to follow with the camera, or stops following if animal is ANIMAL_NONE.
+	void follow(uint8_t animal, int ref_i);
+
+	bool load_replay(const std::string& path);
+	bool seek_replay_year(int year);
+
+};
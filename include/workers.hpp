@@ -0,0 +1,40 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+// A fixed set of threads that all run the same job. The calling thread is worker 0,
+// so a pool of one worker never starts a thread.
+class worker_pool {
+public:
+
+	worker_pool(int count = 1);
+	worker_pool(const worker_pool&) = delete;
+	~worker_pool();
+
+	worker_pool& operator=(const worker_pool&) = delete;
+
+	int size() const {
+		return (int)threads.size() + 1;
+	}
+
+	// Calls job(worker) once for every worker, and returns when all calls have returned.
+	void run(const std::function<void(int)>& job);
+
+private:
+
+	void work(int worker);
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start_condition;
+	std::condition_variable done_condition;
+	const std::function<void(int)>* job = nullptr;
+	unsigned long long generation = 0;
+	int busy = 0;
+	bool stopping = false;
+
+};
@@ -1,5 +1,4 @@
 #include "assets.hpp"
-#include "psim.hpp"
 
 #include <engine.hpp>
 
@@ -50,7 +49,7 @@ shader_assets& _shaders() {
 void texture_assets::initialize() {
 	root("assets/textures");
 	load({ &blank, "blank.png" });
-	load({ &world, STRING(WORLD_SIZE << ".png"), 1, TEXTURE_PIXELS_IN_MEMORY });
+	load({ &world, "2048.png", 1, TEXTURE_PIXELS_IN_MEMORY });
 	spawn_thread();
 	finish();
 }
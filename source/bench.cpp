@@ -0,0 +1,304 @@
+#include "psim.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define BENCH_SEED          1
+#define BENCH_REFERENCE     2048 // The world size the preset counts are meant for.
+#define BENCH_GROUND        0.35 // Share of the generated worlds that is ground.
+#define BENCH_KERNEL_INTERVAL 10   // Ticks between timing breed and hunt.
+
+// A fixed scenario. The animal counts are scaled by the world area, so the density is the same for every size.
+struct bench_scenario {
+	const char* name;
+	const char* preset;
+	int bears;
+	int seals;
+};
+
+static const bench_scenario scenarios[] = {
+	{ "balanced", "balanced", 1000, 100000 },
+	{ "stress", "stress_test", 10000, 1000000 },
+	{ "dense", "stress_test", 30000, 1500000 },
+};
+
+struct bench_result {
+	std::string name;
+	int size = 0;
+	int ticks = 0;
+	uint64_t bear_ticks = 0; // Bears updated, summed over the ticks.
+	uint64_t seal_ticks = 0;
+	phase_timings timings;
+	kernel_timings kernels; // Averaged over the samples.
+	double seconds = 0.0;
+	size_t bears = 0;
+	size_t seals = 0;
+	double peak_rss_mb = 0.0;
+};
+
+static void print_usage() {
+	printf("Usage: psim_bench [--sizes 512,1024,2048] [--scenarios balanced,stress,dense] [--ticks N] [--threads T]\n");
+	printf("                  [--out file.csv] [--baseline file.csv] [--tolerance percent]\n");
+	printf("Runs every scenario on a generated world of every size, and writes a CSV row for each.\n");
+	printf("The times are in nanoseconds per animal per tick, except breed and hunt, which are per call.\n");
+	printf("Breed and hunt are timed on their own, every %i ticks, against the world at that tick.\n", BENCH_KERNEL_INTERVAL);
+	printf("With --baseline, the times are compared to an earlier run, and the exit code is 2 if any got\n");
+	printf("slower by more than the tolerance (10%% by default).\n");
+}
+
+static std::vector<std::string> split(const std::string& string, char separator) {
+	std::vector<std::string> parts;
+	std::stringstream stream(string);
+	std::string part;
+	while (std::getline(stream, part, separator)) {
+		parts.push_back(part);
+	}
+	return parts;
+}
+
+static double peak_rss_mb() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return (double)counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	rusage usage = {};
+	getrusage(RUSAGE_SELF, &usage);
+	return (double)usage.ru_maxrss / 1024.0;
+#endif
+}
+
+// Islands from smoothed noise. The world wraps around, and so does the smoothing.
+static terrain_plane make_bench_terrain(int size) {
+	const size_t cell_count = (size_t)size * (size_t)size;
+	std::vector<float> field(cell_count);
+	std::vector<float> row(size);
+	random_stream random(BENCH_SEED, RANDOM_STREAM_SETUP, size);
+	random.fill_floats(field.data(), cell_count);
+	const int radius = std::max(2, size / 64);
+	for (int pass = 0; pass < 3; pass++) {
+		for (int axis = 0; axis < 2; axis++) {
+			const size_t step = (axis == 0 ? 1 : size);
+			for (int line = 0; line < size; line++) {
+				float* values = field.data() + (axis == 0 ? (size_t)line * size : (size_t)line);
+				float sum = 0.0f;
+				for (int i = -radius; i <= radius; i++) {
+					sum += values[((i + size) % size) * step];
+				}
+				for (int i = 0; i < size; i++) {
+					row[i] = sum / (float)(radius * 2 + 1);
+					sum += values[((i + radius + 1) % size) * step] - values[((i - radius + size) % size) * step];
+				}
+				for (int i = 0; i < size; i++) {
+					values[i * step] = row[i];
+				}
+			}
+		}
+	}
+	std::vector<float> sorted = field;
+	const size_t threshold = (size_t)((1.0 - BENCH_GROUND) * (double)cell_count);
+	std::nth_element(sorted.begin(), sorted.begin() + threshold, sorted.end());
+	const float ground_above = sorted[threshold];
+	auto plane = std::make_shared<std::vector<uint8_t>>(cell_count);
+	for (size_t i = 0; i < cell_count; i++) {
+		(*plane)[i] = (field[i] >= ground_above ? TERRAIN_GROUND : TERRAIN_WATER);
+	}
+	return plane;
+}
+
+static bench_result run_case(const bench_scenario& scenario, int size, const terrain_plane& terrain, int ticks, int threads) {
+	sim_params params;
+	find_preset(scenario.preset, params);
+	const double area = (double)size * (double)size / ((double)BENCH_REFERENCE * (double)BENCH_REFERENCE);
+	params.bears.initial_count = std::max(1, (int)(scenario.bears * area));
+	params.seals.initial_count = std::max(1, (int)(scenario.seals * area));
+	psim sim(terrain, size, params, BENCH_SEED, threads);
+	sim.timing = true;
+	bench_result result;
+	result.name = scenario.name;
+	result.size = size;
+	result.ticks = ticks;
+	int samples = 0;
+	for (int tick = 0; tick < ticks; tick++) {
+		if (tick % BENCH_KERNEL_INTERVAL == 0) {
+			const kernel_timings kernels = sim.time_kernels();
+			result.kernels.hunt += kernels.hunt;
+			result.kernels.breed += kernels.breed;
+			samples++;
+		}
+		result.bear_ticks += sim.bears.size();
+		result.seal_ticks += sim.seals.size();
+		const auto start = std::chrono::steady_clock::now();
+		sim.update();
+		result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	result.kernels.hunt /= samples;
+	result.kernels.breed /= samples;
+	result.timings = sim.timings;
+	result.bears = sim.bears.size();
+	result.seals = sim.seals.size();
+	result.peak_rss_mb = peak_rss_mb();
+	return result;
+}
+
+static double per(double total, uint64_t count) {
+	return count > 0 ? total / (double)count : 0.0;
+}
+
+// The columns that are compared to the baseline, in the order they are written.
+static const char* time_columns[] = { "Bears ns", "Seals ns", "Kill ns", "Breed ns", "Hunt ns", "Tick ns" };
+
+static std::vector<double> time_values(const bench_result& result) {
+	return {
+		per((double)result.timings.bears, result.bear_ticks),
+		per((double)result.timings.seals, result.seal_ticks),
+		per((double)result.timings.kill, result.bear_ticks + result.seal_ticks),
+		result.kernels.breed,
+		result.kernels.hunt,
+		per(result.seconds * 1.0e9, result.bear_ticks + result.seal_ticks)
+	};
+}
+
+static std::string case_name(const bench_result& result) {
+	return result.name + "_" + std::to_string(result.size);
+}
+
+// Reads the time columns of every case in an earlier run.
+static bool load_baseline(const std::string& path, std::map<std::string, std::vector<double>>& baseline) {
+	std::ifstream file(path);
+	std::string line;
+	if (!std::getline(file, line)) {
+		return false;
+	}
+	const std::vector<std::string> header = split(line, ';');
+	std::vector<int> columns;
+	for (const char* name : time_columns) {
+		const auto column = std::find(header.begin(), header.end(), name);
+		if (column == header.end()) {
+			return false;
+		}
+		columns.push_back((int)(column - header.begin()));
+	}
+	while (std::getline(file, line)) {
+		const std::vector<std::string> values = split(line, ';');
+		std::vector<double>& times = baseline[values[0]];
+		for (int column : columns) {
+			times.push_back(column < (int)values.size() ? atof(values[column].c_str()) : 0.0);
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	std::vector<int> sizes = { 512, 1024, 2048 };
+	std::vector<std::string> names = { "balanced", "stress", "dense" };
+	int ticks = 100;
+	int threads = 1;
+	const char* out_path = nullptr;
+	const char* baseline_path = nullptr;
+	double tolerance = 10.0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+			sizes.clear();
+			for (auto& size : split(argv[++i], ',')) {
+				sizes.push_back(atoi(size.c_str()));
+			}
+		} else if (strcmp(argv[i], "--scenarios") == 0 && i + 1 < argc) {
+			names = split(argv[++i], ',');
+		} else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+			ticks = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			out_path = argv[++i];
+		} else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			baseline_path = argv[++i];
+		} else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+			tolerance = atof(argv[++i]);
+		} else {
+			print_usage();
+			return 1;
+		}
+	}
+	for (auto& name : names) {
+		const bool found = std::any_of(std::begin(scenarios), std::end(scenarios), [&](const bench_scenario& scenario) {
+			return name == scenario.name;
+		});
+		if (!found) {
+			fprintf(stderr, "Unknown scenario %s\n", name.c_str());
+			return 1;
+		}
+	}
+	std::map<std::string, std::vector<double>> baseline;
+	if (baseline_path && !load_baseline(baseline_path, baseline)) {
+		fprintf(stderr, "Failed to read baseline %s\n", baseline_path);
+		return 1;
+	}
+	FILE* out = (out_path ? fopen(out_path, "w") : stdout);
+	if (!out) {
+		fprintf(stderr, "Failed to open %s\n", out_path);
+		return 1;
+	}
+
+	fprintf(out, "Case;Scenario;Size;Threads;Ticks;");
+	for (const char* column : time_columns) {
+		fprintf(out, "%s;", column);
+	}
+	fprintf(out, "Bears;Seals;Peak RSS MB;\n");
+	int regressions = 0;
+	// The smallest worlds go first, so the peak memory use grows with each case.
+	std::sort(sizes.begin(), sizes.end());
+	for (int size : sizes) {
+		const terrain_plane terrain = make_bench_terrain(size);
+		for (auto& scenario : scenarios) {
+			if (std::find(names.begin(), names.end(), scenario.name) == names.end()) {
+				continue;
+			}
+			const bench_result result = run_case(scenario, size, terrain, ticks, threads);
+			const std::vector<double> times = time_values(result);
+			const std::string name = case_name(result);
+			fprintf(out, "%s;%s;%i;%i;%i;", name.c_str(), scenario.name, size, threads, ticks);
+			for (double time : times) {
+				fprintf(out, "%.2f;", time);
+			}
+			fprintf(out, "%zu;%zu;%.1f;\n", result.bears, result.seals, result.peak_rss_mb);
+			fflush(out);
+			fprintf(stderr, "%s: %.2f s\n", name.c_str(), result.seconds);
+			const auto previous = baseline.find(name);
+			if (previous == baseline.end()) {
+				continue;
+			}
+			for (size_t i = 0; i < times.size() && i < previous->second.size(); i++) {
+				const double before = previous->second[i];
+				// Differences below a nanosecond are noise, which matters for the phases that take almost no time.
+				if (times[i] > before * (1.0 + tolerance / 100.0) && times[i] - before >= 1.0) {
+					fprintf(stderr, "  %s got slower: %.2f -> %.2f (%+.1f%%)\n", time_columns[i], before, times[i], (times[i] / before - 1.0) * 100.0);
+					regressions++;
+				}
+			}
+		}
+	}
+	if (out != stdout) {
+		fclose(out);
+	}
+	if (regressions > 0) {
+		fprintf(stderr, "%i times got slower than the baseline\n", regressions);
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,223 @@
+#include "checkpoint.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#define CHECKPOINT_MAGIC    "PSCP"
+#define CHECKPOINT_VERSION  3
+
+static_assert(sizeof(int) == sizeof(int32_t), "Animal cells are written as int32.");
+
+static uint64_t align(uint64_t offset) {
+	return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+}
+
+static void save_species(checkpoint_species& out, const species_params& params, const sim_stats::animal_stats& stats, const animal_list& list) {
+	out.initial_count = params.initial_count;
+	out.dead_per_year = params.dead_per_year;
+	out.max_age = params.max_age;
+	out.breed_age = params.breed_age;
+	out.breed_probability = params.breed_probability;
+	out.hunger_hungry = params.hunger_hungry;
+	out.hunger_rate = params.hunger_rate;
+	out.kill_by = params.kill_by;
+	out.kill_crowding = params.kill_crowding;
+	out.dead_from_hunger = stats.dead_from_hunger;
+	out.born = stats.born;
+	out.dead_from_age = stats.dead_from_age;
+	out.dead_randomly = stats.dead_randomly;
+	out.kill_chance = stats.kill_chance;
+	out.count = list.size();
+}
+
+static species_params load_species_params(const checkpoint_species& in) {
+	return { in.initial_count, in.dead_per_year, in.max_age, in.breed_age, in.breed_probability, in.hunger_hungry, in.hunger_rate, in.kill_by, in.kill_crowding };
+}
+
+static sim_stats::animal_stats load_species_stats(const checkpoint_species& in) {
+	sim_stats::animal_stats stats;
+	stats.dead_from_hunger = in.dead_from_hunger;
+	stats.born = in.born;
+	stats.dead_from_age = in.dead_from_age;
+	stats.dead_randomly = in.dead_randomly;
+	stats.kill_chance = in.kill_chance;
+	return stats;
+}
+
+checkpoint::~checkpoint() {
+	close();
+}
+
+bool checkpoint::open(const std::string& path) {
+	close();
+	if (!file.open(path) || file.size() < sizeof(checkpoint_header)) {
+		close();
+		return false;
+	}
+	data = file.data();
+	size = file.size();
+	const checkpoint_header& check = header();
+	const uint64_t cell_count = (uint64_t)check.world_size * (uint64_t)check.world_size;
+	bool valid = memcmp(check.magic, CHECKPOINT_MAGIC, 4) == 0 && check.version == CHECKPOINT_VERSION;
+	valid = valid && check.world_size > 0 && check.world_size <= MAX_WORLD_SIZE && check.ticks_per_year > 0;
+	valid = valid && check.terrain + cell_count <= size && check.occupants + cell_count <= size;
+	for (const checkpoint_species* species : { &check.bears, &check.seals }) {
+		valid = valid && species->cells + species->count * sizeof(int32_t) <= size;
+		valid = valid && species->hunger + species->count * sizeof(float) <= size;
+		valid = valid && species->age + species->count <= size;
+		valid = valid && species->direction + species->count <= size;
+		valid = valid && species->birthday + species->count * sizeof(int32_t) <= size;
+		if (!valid) {
+			break;
+		}
+		const int32_t* cells = at<int32_t>(species->cells);
+		for (uint64_t i = 0; i < species->count && valid; i++) {
+			valid = cells[i] >= 0 && (uint64_t)cells[i] < cell_count;
+		}
+	}
+	if (!valid) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void checkpoint::close() {
+	file.close();
+	data = nullptr;
+	size = 0;
+}
+
+sim_params checkpoint::params() const {
+	sim_params params;
+	params.ticks_per_year = header().ticks_per_year;
+	params.bears = load_species_params(header().bears);
+	params.seals = load_species_params(header().seals);
+	return params;
+}
+
+uint64_t checkpoint::seed() const {
+	return header().seed;
+}
+
+sim_stats checkpoint::stats() const {
+	sim_stats stats;
+	stats.bears = load_species_stats(header().bears);
+	stats.seals = load_species_stats(header().seals);
+	stats.seals_eaten_by_bears = header().seals_eaten_by_bears;
+	return stats;
+}
+
+terrain_plane checkpoint::make_terrain() const {
+	const uint8_t* terrain = at<uint8_t>(header().terrain);
+	const size_t cell_count = (size_t)header().world_size * (size_t)header().world_size;
+	return std::make_shared<const std::vector<uint8_t>>(terrain, terrain + cell_count);
+}
+
+const uint8_t* checkpoint::occupants() const {
+	return at<uint8_t>(header().occupants);
+}
+
+void checkpoint::read_animals(const checkpoint_species& species, animal_list& list) const {
+	const size_t count = (size_t)species.count;
+	list.cells.assign(at<int32_t>(species.cells), at<int32_t>(species.cells) + count);
+	list.hunger.assign(at<float>(species.hunger), at<float>(species.hunger) + count);
+	list.age.assign(at<uint8_t>(species.age), at<uint8_t>(species.age) + count);
+	list.direction.assign(at<int8_t>(species.direction), at<int8_t>(species.direction) + count);
+	list.birthday.assign(at<int32_t>(species.birthday), at<int32_t>(species.birthday) + count);
+}
+
+checkpoint_writer::~checkpoint_writer() {
+	wait();
+}
+
+void checkpoint_writer::save(const psim& sim, const std::string& path) {
+	wait();
+	this->path = path;
+	header = {};
+	memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+	header.version = CHECKPOINT_VERSION;
+	header.seed = sim.seed;
+	header.world_size = sim.world_size;
+	header.ticks_per_year = sim.params.ticks_per_year;
+	header.year = sim.year;
+	header.ticks = sim.ticks;
+	header.new_year = sim.new_year ? 1 : 0;
+	header.seals_eaten_by_bears = sim.stats.seals_eaten_by_bears;
+	save_species(header.bears, sim.params.bears, sim.stats.bears, sim.bears);
+	save_species(header.seals, sim.params.seals, sim.stats.seals, sim.seals);
+
+	// Lay out the file.
+	const uint64_t cell_count = (uint64_t)sim.world_size * (uint64_t)sim.world_size;
+	uint64_t offset = align(sizeof(header));
+	header.terrain = offset;
+	offset = align(offset + cell_count);
+	header.occupants = offset;
+	offset = align(offset + cell_count);
+	for (checkpoint_species* species : { &header.bears, &header.seals }) {
+		species->cells = offset;
+		offset = align(offset + species->count * sizeof(int32_t));
+		species->hunger = offset;
+		offset = align(offset + species->count * sizeof(float));
+		species->age = offset;
+		offset = align(offset + species->count);
+		species->direction = offset;
+		offset = align(offset + species->count);
+		species->birthday = offset;
+		offset = align(offset + species->count * sizeof(int32_t));
+	}
+
+	// The terrain never changes, so it is shared rather than copied.
+	terrain = sim.terrain;
+	occupants = sim.occupants;
+	bears = sim.bears;
+	seals = sim.seals;
+	writer = std::thread([this] {
+		write();
+	});
+}
+
+bool checkpoint_writer::wait() {
+	if (writer.joinable()) {
+		writer.join();
+	}
+	return ok;
+}
+
+void checkpoint_writer::write() {
+	const std::string partial_path = path + ".part";
+	std::ofstream file(partial_path, std::ios::binary);
+	auto write_at = [&](uint64_t offset, const void* data, size_t size) {
+		static const char padding[CHECKPOINT_ALIGNMENT] = {};
+		if (!file) {
+			return;
+		}
+		const uint64_t position = (uint64_t)file.tellp();
+		file.write(padding, offset - position);
+		file.write((const char*)data, size);
+	};
+	write_at(0, &header, sizeof(header));
+	write_at(header.terrain, terrain->data(), terrain->size());
+	write_at(header.occupants, occupants.data(), occupants.size());
+	for (auto [species, list] : { std::make_pair(&header.bears, &bears), std::make_pair(&header.seals, &seals) }) {
+		write_at(species->cells, list->cells.data(), list->cells.size() * sizeof(int32_t));
+		write_at(species->hunger, list->hunger.data(), list->hunger.size() * sizeof(float));
+		write_at(species->age, list->age.data(), list->age.size());
+		write_at(species->direction, list->direction.data(), list->direction.size());
+		write_at(species->birthday, list->birthday.data(), list->birthday.size() * sizeof(int32_t));
+	}
+	file.close();
+	ok = (bool)file;
+	std::error_code error;
+	if (ok) {
+		std::filesystem::rename(partial_path, path, error);
+		ok = !error;
+	}
+	if (!ok) {
+		std::filesystem::remove(partial_path, error);
+	}
+	terrain = {};
+	occupants = {};
+	bears = {};
+	seals = {};
+}
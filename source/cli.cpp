@@ -0,0 +1,164 @@
+#include "psim.hpp"
+#include "checkpoint.hpp"
+#include "terrain.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+
+static void print_usage() {
+	printf("Usage: psim_cli <world.png|world.raw|checkpoint.pscp> [--scenario preset|file.ini] [--years N] [--seed S] [--threads T]\n");
+	printf("                [--events file.psev] [--replay file.psrp] [--checkpoint file.pscp] [--checkpoint-every N]\n");
+	printf("                [--regions file.psrg] [--trace file.json] [--quiet]\n");
+	printf("Presets: balanced (default), bears_die, both_die, stress_test\n");
+	printf("A run started from a checkpoint continues for N more years, with the saved scenario and seed unless they are given.\n");
+	printf("--checkpoint saves the run when it ends, and every N years with --checkpoint-every.\n");
+	printf("--trace writes the profiled zones of the last ticks in the Chrome trace format.\n");
+}
+
+static void print_stats(const psim& sim) {
+	printf("Bears: %zu\n", sim.bears.size());
+	printf("Seals: %zu\n", sim.seals.size());
+	printf("Seals dead from hunger: %i\n", sim.stats.seals.dead_from_hunger);
+	printf("Bears dead from hunger: %i\n", sim.stats.bears.dead_from_hunger);
+	printf("Seals born: %i\n", sim.stats.seals.born);
+	printf("Bears born: %i\n", sim.stats.bears.born);
+	printf("Seals dead from age: %i\n", sim.stats.seals.dead_from_age);
+	printf("Bears dead from age: %i\n", sim.stats.bears.dead_from_age);
+	printf("Seals dead randomly: %i\n", sim.stats.seals.dead_randomly);
+	printf("Bears dead randomly: %i\n", sim.stats.bears.dead_randomly);
+	printf("Seals eaten by bears: %i\n", sim.stats.seals_eaten_by_bears);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		print_usage();
+		return 1;
+	}
+	const char* world_path = argv[1];
+	const char* scenario = nullptr;
+	int years = 10;
+	uint64_t seed = (uint64_t)time(nullptr);
+	bool has_seed = false;
+	int threads = 1;
+	const char* events_path = nullptr;
+	const char* replay_path = nullptr;
+	const char* regions_path = nullptr;
+	const char* checkpoint_path = nullptr;
+	int checkpoint_years = 0;
+	const char* trace_path = nullptr;
+	bool quiet = false;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+			scenario = argv[++i];
+		} else if (strcmp(argv[i], "--years") == 0 && i + 1 < argc) {
+			years = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], nullptr, 10);
+			has_seed = true;
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--events") == 0 && i + 1 < argc) {
+			events_path = argv[++i];
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replay_path = argv[++i];
+		} else if (strcmp(argv[i], "--regions") == 0 && i + 1 < argc) {
+			regions_path = argv[++i];
+		} else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+			checkpoint_path = argv[++i];
+		} else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+			checkpoint_years = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+		} else if (strcmp(argv[i], "--quiet") == 0) {
+			quiet = true;
+		} else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	const auto start_time = std::chrono::steady_clock::now();
+	checkpoint from;
+	const bool resume = from.open(world_path);
+	sim_params params = resume ? from.params() : sim_params{};
+	std::string error;
+	if (scenario && !load_scenario_or_preset(scenario, params, error)) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	if (resume && !has_seed) {
+		seed = from.seed();
+	}
+
+	terrain_plane terrain;
+	terrain_cells cells;
+	int size = 0;
+	if (!resume && !load_cached_terrain(world_path, terrain, cells, size)) {
+		fprintf(stderr, "Failed to load world map %s\n", world_path);
+		return 1;
+	}
+
+	std::unique_ptr<psim> sim_pointer;
+	if (resume) {
+		sim_pointer = std::make_unique<psim>(from, from.make_terrain(), params, seed, threads);
+		from.close();
+	} else {
+		sim_pointer = std::make_unique<psim>(terrain, std::move(cells), size, params, seed, threads);
+	}
+	psim& sim = *sim_pointer;
+	if (events_path && !sim.open_event_log(events_path)) {
+		fprintf(stderr, "Failed to open event log %s\n", events_path);
+		return 1;
+	}
+	if (replay_path && !sim.open_replay(replay_path)) {
+		fprintf(stderr, "Failed to open replay %s\n", replay_path);
+		return 1;
+	}
+	if (regions_path && !sim.open_region_log(regions_path)) {
+		fprintf(stderr, "Failed to open region log %s\n", regions_path);
+		return 1;
+	}
+	const auto ready_time = std::chrono::steady_clock::now();
+	const int ticks_per_year = params.ticks_per_year;
+	checkpoint_writer checkpoints;
+	for (int tick = 0; tick < years * ticks_per_year; tick++) {
+		sim.update();
+		if (sim.ticks % ticks_per_year != 0) {
+			continue;
+		}
+		if (!quiet) {
+			printf("Year %i: %zu bears, %zu seals\n", sim.ticks / ticks_per_year, sim.bears.size(), sim.seals.size());
+		}
+		if (checkpoint_path && checkpoint_years > 0 && (sim.ticks / ticks_per_year) % checkpoint_years == 0 && tick + 1 < years * ticks_per_year) {
+			checkpoints.save(sim, checkpoint_path);
+		}
+	}
+	if (checkpoint_path) {
+		checkpoints.save(sim, checkpoint_path);
+	}
+	sim.close_event_log();
+	sim.close_replay();
+	sim.close_region_log();
+	if (!checkpoints.wait()) {
+		fprintf(stderr, "Failed to write checkpoint %s\n", checkpoint_path);
+		return 1;
+	}
+	const auto end_time = std::chrono::steady_clock::now();
+	if (trace_path && (!PROFILER_ENABLED || !get_profiler().write_chrome_trace(trace_path))) {
+		fprintf(stderr, "Failed to write trace %s\n", trace_path);
+	}
+
+	const double setup_seconds = std::chrono::duration<double>(ready_time - start_time).count();
+	const double run_seconds = std::chrono::duration<double>(end_time - ready_time).count();
+	print_stats(sim);
+	printf("Scenario: %s\n", scenario ? scenario : resume ? world_path : "balanced");
+	printf("Seed: %llu\n", (unsigned long long)seed);
+	printf("Threads: %i\n", sim.workers.size());
+	printf("Setup: %.3f s\n", setup_seconds);
+	printf("Simulated %i years in %.3f s (%.2f years/s)\n", years, run_seconds, run_seconds > 0.0 ? years / run_seconds : 0.0);
+	return 0;
+}
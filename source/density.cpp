@@ -0,0 +1,174 @@
+#include "density.hpp"
+#include "psim.hpp"
+#include <algorithm>
+#include <cstring>
+
+#define REGION_MAGIC    "PSRG"
+#define REGION_VERSION  1
+
+// 1 in each byte of the word that is 0, and 0 in the others.
+static uint64_t zero_lanes(uint64_t bytes) {
+	return ~(((bytes & BYTE_LANES(0x7F)) + BYTE_LANES(0x7F)) | bytes | BYTE_LANES(0x7F)) >> 7;
+}
+
+// The sum of the 4 lowest bytes of the word.
+static uint16_t sum_lanes(uint64_t lanes) {
+	return (uint16_t)((((lanes & 0xFFFFFFFFull) * 0x01010101ull) >> 24) & 0xFF);
+}
+
+void density_pyramid::resize(int world_size) {
+	this->world_size = world_size;
+	for (int i = 0; i < DENSITY_LEVELS; i++) {
+		density_level& level = levels[i];
+		level.block_size = DENSITY_BLOCK_SIZE(i);
+		level.per_row = (world_size + level.block_size - 1) / level.block_size;
+		const size_t count = (size_t)level.per_row * (size_t)level.per_row;
+		level.bears.assign(count, 0);
+		level.seals.assign(count, 0);
+		level.open_water.assign(count, 0);
+	}
+}
+
+void density_pyramid::recount(const uint8_t* occupants, const uint8_t* terrain, int x, int y, int size) {
+	const int end_x = std::min(x + size, world_size);
+	const int end_y = std::min(y + size, world_size);
+
+	// The first level, from the cells. Two blocks side by side are counted at once, with the 8 cells of their rows
+	// compared as the bytes of a word, and the matches added up in the bytes of another.
+	density_level& first = levels[0];
+	for (int block_y = y / 4; block_y < (end_y + 3) / 4; block_y++) {
+		const int cell_end_y = std::min(block_y * 4 + 4, world_size);
+		int block_x = x / 4;
+		for (; block_x * 4 + 8 <= end_x; block_x += 2) {
+			uint64_t bears = 0;
+			uint64_t seals = 0;
+			uint64_t open_water = 0;
+			for (int cell_y = block_y * 4; cell_y < cell_end_y; cell_y++) {
+				const size_t cell_i = (size_t)cell_y * world_size + block_x * 4;
+				uint64_t animals = 0;
+				uint64_t water = 0;
+				memcpy(&animals, occupants + cell_i, 8);
+				memcpy(&water, terrain + cell_i, 8);
+				bears += zero_lanes(animals ^ BYTE_LANES(ANIMAL_BEAR));
+				seals += zero_lanes(animals ^ BYTE_LANES(ANIMAL_SEAL));
+				open_water += zero_lanes(animals | (water ^ BYTE_LANES(TERRAIN_WATER)));
+			}
+			const size_t block = (size_t)block_x + (size_t)block_y * first.per_row;
+			first.bears[block] = sum_lanes(bears);
+			first.bears[block + 1] = sum_lanes(bears >> 32);
+			first.seals[block] = sum_lanes(seals);
+			first.seals[block + 1] = sum_lanes(seals >> 32);
+			first.open_water[block] = sum_lanes(open_water);
+			first.open_water[block + 1] = sum_lanes(open_water >> 32);
+		}
+		// A block left over at the right edge of the square, or cut off by the world.
+		for (; block_x < (end_x + 3) / 4; block_x++) {
+			const size_t block = (size_t)block_x + (size_t)block_y * first.per_row;
+			first.bears[block] = 0;
+			first.seals[block] = 0;
+			first.open_water[block] = 0;
+			for (int cell_y = block_y * 4; cell_y < cell_end_y; cell_y++) {
+				for (int cell_x = block_x * 4; cell_x < std::min(block_x * 4 + 4, world_size); cell_x++) {
+					const size_t cell_i = (size_t)cell_y * world_size + cell_x;
+					first.bears[block] += (occupants[cell_i] == ANIMAL_BEAR);
+					first.seals[block] += (occupants[cell_i] == ANIMAL_SEAL);
+					first.open_water[block] += (occupants[cell_i] == ANIMAL_NONE && terrain[cell_i] == TERRAIN_WATER);
+				}
+			}
+		}
+	}
+
+	// The other levels, from the 4 by 4 blocks under each of their blocks.
+	for (int i = 1; i < DENSITY_LEVELS; i++) {
+		density_level& level = levels[i];
+		const density_level& below = levels[i - 1];
+		for (int block_y = y / level.block_size; block_y <= (end_y - 1) / level.block_size; block_y++) {
+			for (int block_x = x / level.block_size; block_x <= (end_x - 1) / level.block_size; block_x++) {
+				int bears = 0;
+				int seals = 0;
+				int open_water = 0;
+				for (int below_y = block_y * 4; below_y < std::min(block_y * 4 + 4, below.per_row); below_y++) {
+					for (int below_x = block_x * 4; below_x < std::min(block_x * 4 + 4, below.per_row); below_x++) {
+						const size_t block = (size_t)below_x + (size_t)below_y * below.per_row;
+						bears += below.bears[block];
+						seals += below.seals[block];
+						open_water += below.open_water[block];
+					}
+				}
+				const size_t block = (size_t)block_x + (size_t)block_y * level.per_row;
+				level.bears[block] = (uint16_t)bears;
+				level.seals[block] = (uint16_t)seals;
+				level.open_water[block] = (uint16_t)open_water;
+			}
+		}
+	}
+}
+
+uint32_t density_pyramid::pixel(int level_index, int block) const {
+	const density_level& level = levels[level_index];
+	const int block_x = block % level.per_row;
+	const int block_y = block / level.per_row;
+	const int width = std::min(level.block_size, world_size - block_x * level.block_size);
+	const int height = std::min(level.block_size, world_size - block_y * level.block_size);
+	const uint32_t cells = (uint32_t)(width * height);
+	const uint32_t bears = level.bears[block];
+	const uint32_t seals = level.seals[block];
+	const uint32_t open_water = level.open_water[block];
+	const uint32_t open_ground = cells - bears - seals - open_water;
+	uint32_t colour = 0xFF000000;
+	for (int shift = 0; shift < 24; shift += 8) {
+		const uint32_t sum = bears * ((BEAR >> shift) & 0xFF) + seals * ((SEAL >> shift) & 0xFF)
+			+ open_water * ((WATER >> shift) & 0xFF) + open_ground * ((GROUND >> shift) & 0xFF);
+		colour |= (sum / cells) << shift;
+	}
+	return colour;
+}
+
+void region_grid::resize(int world_size, int region_size) {
+	this->region_size = region_size;
+	per_row = (world_size + region_size - 1) / region_size;
+	bears.assign((size_t)per_row * (size_t)per_row, 0);
+	seals.assign(bears.size(), 0);
+}
+
+void region_grid::take(region_grid& other) {
+	for (size_t i = 0; i < bears.size(); i++) {
+		bears[i] += other.bears[i];
+		seals[i] += other.seals[i];
+	}
+	std::fill(other.bears.begin(), other.bears.end(), 0);
+	std::fill(other.seals.begin(), other.seals.end(), 0);
+}
+
+region_writer::~region_writer() {
+	close();
+}
+
+bool region_writer::open(const std::string& path, int world_size, const region_grid& grid, int ticks_per_year) {
+	close();
+	file.open(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	const uint32_t header[5] = { REGION_VERSION, (uint32_t)world_size, (uint32_t)grid.region_size, (uint32_t)grid.per_row, (uint32_t)ticks_per_year };
+	file.write(REGION_MAGIC, 4);
+	file.write((const char*)header, sizeof(header));
+	written_tick = -1;
+	return (bool)file;
+}
+
+void region_writer::close() {
+	if (file.is_open()) {
+		file.close();
+	}
+}
+
+void region_writer::write(int tick, const region_grid& grid) {
+	counts.resize(grid.bears.size() + grid.seals.size());
+	std::copy(grid.bears.begin(), grid.bears.end(), counts.begin());
+	std::copy(grid.seals.begin(), grid.seals.end(), counts.begin() + grid.bears.size());
+	const uint32_t frame_tick = (uint32_t)tick;
+	file.write((const char*)&frame_tick, sizeof(frame_tick));
+	file.write((const char*)counts.data(), counts.size() * sizeof(uint16_t));
+	written_tick = tick;
+}
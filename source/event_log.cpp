@@ -0,0 +1,129 @@
+#include "event_log.hpp"
+#include <cstring>
+#include <memory>
+
+#define EVENT_LOG_MAGIC   "PSEV"
+#define EVENT_LOG_VERSION 1
+
+event_log::~event_log() {
+	close();
+}
+
+bool event_log::open(const std::string& path, int producers) {
+	close();
+	file.open(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	const uint32_t version = EVENT_LOG_VERSION;
+	file.write(EVENT_LOG_MAGIC, 4);
+	file.write((const char*)&version, sizeof(version));
+	// Every producer holds one block, and can have one queued while it fills the next.
+	blocks = std::vector<event_block>(producers * 2 + 2);
+	free.clear();
+	queued.clear();
+	for (auto& block : blocks) {
+		free.push_back(&block);
+	}
+	closing = false;
+	writer = std::thread([this] {
+		write_blocks();
+	});
+	return true;
+}
+
+void event_log::close() {
+	if (!writer.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	queued_condition.notify_one();
+	writer.join();
+	file.close();
+	blocks = {};
+}
+
+event_block* event_log::take() {
+	std::unique_lock<std::mutex> lock(mutex);
+	free_condition.wait(lock, [this] {
+		return !free.empty();
+	});
+	event_block* block = free.back();
+	free.pop_back();
+	block->count = 0;
+	return block;
+}
+
+event_block* event_log::swap(event_block* full) {
+	submit(full);
+	return take();
+}
+
+void event_log::submit(event_block* block) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(block);
+	}
+	queued_condition.notify_one();
+}
+
+void event_log::write_blocks() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		queued_condition.wait(lock, [this] {
+			return closing || !queued.empty();
+		});
+		if (queued.empty()) {
+			return;
+		}
+		std::vector<event_block*> writing;
+		writing.swap(queued);
+		lock.unlock();
+		for (event_block* block : writing) {
+			if (block->count == 0) {
+				continue;
+			}
+			const size_t count = block->count;
+			file.write((const char*)&block->count, sizeof(block->count));
+			file.write((const char*)block->tick, count * sizeof(block->tick[0]));
+			file.write((const char*)block->hunger, count * sizeof(block->hunger[0]));
+			file.write((const char*)block->type, count);
+			file.write((const char*)block->animal, count);
+			file.write((const char*)block->age, count);
+		}
+		lock.lock();
+		free.insert(free.end(), writing.begin(), writing.end());
+		free_condition.notify_all();
+	}
+}
+
+bool read_event_log(const std::string& path, const std::function<void(const event_block&)>& read) {
+	std::ifstream file(path, std::ios::binary);
+	char magic[4] = {};
+	uint32_t version = 0;
+	file.read(magic, 4);
+	file.read((char*)&version, sizeof(version));
+	if (!file || memcmp(magic, EVENT_LOG_MAGIC, 4) != 0 || version != EVENT_LOG_VERSION) {
+		return false;
+	}
+	auto block = std::make_unique<event_block>();
+	while (file.read((char*)&block->count, sizeof(block->count))) {
+		const size_t count = block->count;
+		if (count > EVENT_BLOCK_SIZE) {
+			return false;
+		}
+		file.read((char*)block->tick, count * sizeof(block->tick[0]));
+		file.read((char*)block->hunger, count * sizeof(block->hunger[0]));
+		file.read((char*)block->type, count);
+		file.read((char*)block->animal, count);
+		file.read((char*)block->age, count);
+		if (!file) {
+			return false;
+		}
+		read(*block);
+	}
+	return true;
+}
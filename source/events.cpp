@@ -0,0 +1,66 @@
+#include "event_log.hpp"
+#include "psim.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+static const char* animal_name(uint8_t animal) {
+	switch (animal) {
+	case ANIMAL_BEAR: return "Bear";
+	case ANIMAL_SEAL: return "Seal";
+	default: return "Unknown";
+	}
+}
+
+static const char* death_name(uint8_t type) {
+	switch (type) {
+	case EVENT_DEATH_RANDOM: return "Random";
+	case EVENT_DEATH_EATEN: return "Eaten";
+	case EVENT_DEATH_STARVED: return "Starved";
+	case EVENT_DEATH_AGED: return "Aged";
+	default: return "Unknown";
+	}
+}
+
+// Converts an event log to the deaths and births CSV files.
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		printf("Usage: psim_events <events.psev> [--out prefix]\n");
+		printf("Writes prefix_deaths.csv and prefix_births.csv. The prefix is the log path without the extension by default.\n");
+		return 1;
+	}
+	const std::string path = argv[1];
+	std::string prefix = path.substr(0, path.rfind('.'));
+	if (argc >= 4 && strcmp(argv[2], "--out") == 0) {
+		prefix = argv[3];
+	}
+	FILE* deaths = fopen((prefix + "_deaths.csv").c_str(), "w");
+	FILE* births = fopen((prefix + "_births.csv").c_str(), "w");
+	if (!deaths || !births) {
+		fprintf(stderr, "Failed to open %s_deaths.csv or %s_births.csv\n", prefix.c_str(), prefix.c_str());
+		return 1;
+	}
+	fprintf(deaths, "Reason;Age;Hunger;Animal;Tick;\n");
+	fprintf(births, "Animal;Tick;\n");
+	size_t death_count = 0;
+	size_t birth_count = 0;
+	const bool ok = read_event_log(path, [&](const event_block& block) {
+		for (uint32_t i = 0; i < block.count; i++) {
+			if (block.type[i] == EVENT_BIRTH) {
+				fprintf(births, "%s;%i;\n", animal_name(block.animal[i]), block.tick[i]);
+				birth_count++;
+			} else {
+				fprintf(deaths, "%s;%i;%g;%s;%i;\n", death_name(block.type[i]), (int)block.age[i], block.hunger[i], animal_name(block.animal[i]), block.tick[i]);
+				death_count++;
+			}
+		}
+	});
+	fclose(deaths);
+	fclose(births);
+	if (!ok) {
+		fprintf(stderr, "%s is not a complete event log\n", path.c_str());
+		return 1;
+	}
+	printf("%zu deaths, %zu births\n", death_count, birth_count);
+	return 0;
+}
@@ -2,6 +2,7 @@
 #include <SDL/SDL.h>
 
 #include "psim.hpp"
+#include "view.hpp"
 #include "assets.hpp"
 
 #include <engine.hpp>
@@ -10,6 +11,29 @@
 #include <ui.hpp>
 #include <graphics.hpp>
 
+// Falls back to the balanced preset if the scenario can not be loaded.
+static sim_params load_sim_params() {
+	sim_params params;
+	std::string error;
+	if (!load_scenario(SIM_SCENARIO, params, error)) {
+		fprintf(stderr, "%s\n", error.c_str());
+		params = {};
+	}
+	return params;
+}
+
+static psim make_sim() {
+	const int threads = (int)std::thread::hardware_concurrency();
+#if SIM_RESUME
+	checkpoint from;
+	if (from.open(LOAD_CHECKPOINT)) {
+		return psim(from, threads);
+	}
+	fprintf(stderr, "Failed to load checkpoint %s\n", LOAD_CHECKPOINT);
+#endif
+	return psim(textures.world.pixels, textures.world.size.x, load_sim_params(), (uint64_t)time(nullptr), threads);
+}
+
 class sim_state : public ne::program_state {
 public:
 
@@ -18,8 +42,9 @@ public:
 	ne::drawing_shape quad;
 
 	psim sim;
+	psim_view sim_view;
 
-	sim_state::sim_state() {
+	sim_state::sim_state() : sim(make_sim()), sim_view(sim) {
 		camera.zoom = 2.0f;
 		camera.target_chase_speed = 2.0f;
 		camera.target_chase_aspect = 2.0f;
@@ -37,8 +62,7 @@ public:
 			if (key.is_pressed && key.key == KEY_R) {
 				camera.transform.position.xy = -100.0f;
 				camera.zoom = 1.0f;
-				sim.bb.refs = nullptr;
-				sim.bb.ref_i = -1;
+				sim_view.follow(ANIMAL_NONE, -1);
 			}
 		});
 	}
@@ -59,33 +83,43 @@ public:
 			camera.transform.position.y += 20.0f;
 		}
 		camera.update();
-		sim.update();
+		sim_view.update();
+		// The simulation is on its own thread, so everything shown comes from the last snapshot.
+		const sim_snapshot& snapshot = sim_view.runner.front();
+		const int day = (int)((float)(snapshot.ticks % sim.params.ticks_per_year) * 365.0f / (float)sim.params.ticks_per_year);
+#if PROFILER_ENABLED
+		// Summarised every update, so the averages are per frame.
+		const std::string profile = get_profiler().summary(snapshot.counters);
+#else
+		const std::string profile;
+#endif
 		if (ne::is_key_down(KEY_F)) {
 			debug.set(&fonts.debug, STRING(
 				"Delta " << ne::delta() <<
 				"\nFPS: " << ne::current_fps() <<
-				"\nBears: " << sim.bears.size() <<
-				"\nSeals: " << sim.seals.size() <<
-				"\nSeals dead from hunger: " << sim.stats.seals.dead_from_hunger <<
-				"\nBears dead from hunger: " << sim.stats.bears.dead_from_hunger <<
-				"\nSeals born: " << sim.stats.seals.born <<
-				"\nBears born: " << sim.stats.bears.born <<
-				"\nSeals dead from age: " << sim.stats.seals.dead_from_age <<
-				"\nBears dead from age: " << sim.stats.bears.dead_from_age <<
-				"\nSeals dead randomly: " << sim.stats.seals.dead_randomly <<
-				"\nBears dead randomly: " << sim.stats.bears.dead_randomly <<
-				"\nSeals eaten by bears: " << sim.stats.seals_eaten_by_bears <<
-				"\n\nYear: " << sim.year <<
-				"\nDay: " << (int)((float)(sim.ticks % 500) * 0.73f)
+				"\nBears: " << snapshot.bears <<
+				"\nSeals: " << snapshot.seals <<
+				"\nSeals dead from hunger: " << snapshot.stats.seals.dead_from_hunger <<
+				"\nBears dead from hunger: " << snapshot.stats.bears.dead_from_hunger <<
+				"\nSeals born: " << snapshot.stats.seals.born <<
+				"\nBears born: " << snapshot.stats.bears.born <<
+				"\nSeals dead from age: " << snapshot.stats.seals.dead_from_age <<
+				"\nBears dead from age: " << snapshot.stats.bears.dead_from_age <<
+				"\nSeals dead randomly: " << snapshot.stats.seals.dead_randomly <<
+				"\nBears dead randomly: " << snapshot.stats.bears.dead_randomly <<
+				"\nSeals eaten by bears: " << snapshot.stats.seals_eaten_by_bears <<
+				"\n\nYear: " << snapshot.year <<
+				"\nDay: " << day <<
+				"\n" << profile
 			));
 		} else {
 			debug.set(&fonts.debug, STRING(
 				"Delta " << ne::delta() <<
 				"\nFPS: " << ne::current_fps() <<
-				"\nBears: " << sim.bears.size() <<
-				"\nSeals: " << sim.seals.size() <<
-				"\n\nYear: " << sim.year <<
-				"\nDay: " << (int)((float)(sim.ticks % 500) * 0.73f)
+				"\nBears: " << snapshot.bears <<
+				"\nSeals: " << snapshot.seals <<
+				"\n\nYear: " << snapshot.year <<
+				"\nDay: " << day
 			));
 		}
 	}
@@ -99,7 +133,7 @@ public:
 		ne::transform3f view;
 		view.position.xy = camera.xy();
 		view.scale.xy = camera.size();
-		sim.draw();
+		sim_view.draw();
 
 		// UI
 		quad.bind();
@@ -121,13 +155,8 @@ void start() {
 	ne::maximise_window();
 	load_assets();
 	ne::set_update_sync(false);
-	ne::set_max_update_count(MAX_TICKS_PER_DRAW);
+	ne::set_max_update_count(1);
 	ne::set_swap_interval(ne::swap_interval::immediate);
-	for (int i = 0; i < WORLD_SIZE * WORLD_SIZE; i++) {
-		if (TERRAIN_AT(i) != WATER) {
-			TERRAIN_AT(i) = GROUND;
-		}
-	}
 	textures.world.parameters.are_pixels_in_memory = false;
 	textures.world.render();
 	ne::swap_state<sim_state>();
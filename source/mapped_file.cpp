@@ -0,0 +1,73 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::~mapped_file() {
+	close();
+}
+
+bool mapped_file::open(const std::string& path) {
+	close();
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		return false;
+	}
+	LARGE_INTEGER file_size = {};
+	GetFileSizeEx(file, &file_size);
+	length = (size_t)file_size.QuadPart;
+	mapping = (length > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr);
+	if (mapping) {
+		bytes = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	const int file = ::open(path.c_str(), O_RDONLY);
+	if (file == -1) {
+		return false;
+	}
+	struct stat file_stat = {};
+	if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+		length = (size_t)file_stat.st_size;
+		void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+		bytes = (mapped == MAP_FAILED ? nullptr : (const uint8_t*)mapped);
+	}
+	::close(file);
+#endif
+	if (!bytes) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void mapped_file::close() {
+#ifdef _WIN32
+	if (bytes) {
+		UnmapViewOfFile(bytes);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	if (file) {
+		CloseHandle(file);
+	}
+	mapping = nullptr;
+	file = nullptr;
+#else
+	if (bytes) {
+		munmap((void*)bytes, length);
+	}
+#endif
+	bytes = nullptr;
+	length = 0;
+}
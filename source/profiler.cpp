@@ -0,0 +1,131 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+static const char* zone_names[ZONE_COUNT] = {
+	"update", "kill", "bucket", "vitals", "bears", "seals", "tiles", "finish pass", "replay", "draw", "upload"
+};
+
+static const char* counter_names[COUNTER_COUNT] = {
+	"moves tried", "moves", "hunts", "births", "cells probed"
+};
+
+const char* profile_zone_name(int zone) {
+	return zone >= 0 && zone < ZONE_COUNT ? zone_names[zone] : "unknown";
+}
+
+const char* profile_counter_name(int counter) {
+	return counter >= 0 && counter < COUNTER_COUNT ? counter_names[counter] : "unknown";
+}
+
+void profile_counters::take(profile_counters& other) {
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		values[i] += other.values[i];
+		other.values[i] = 0;
+	}
+}
+
+void profile_buffer::read(std::vector<profile_event>& out) const {
+	const uint64_t end = written.load(std::memory_order_acquire);
+	const uint64_t begin = (end > PROFILE_BUFFER_SIZE ? end - PROFILE_BUFFER_SIZE : 0);
+	const size_t first = out.size();
+	for (uint64_t i = begin; i < end; i++) {
+		out.push_back(events[i & (PROFILE_BUFFER_SIZE - 1)]);
+	}
+	// Events the thread wrote over while they were copied are dropped.
+	const uint64_t after = written.load(std::memory_order_acquire);
+	if (after > begin + PROFILE_BUFFER_SIZE) {
+		const uint64_t overwritten = std::min(after - PROFILE_BUFFER_SIZE, end) - begin;
+		out.erase(out.begin() + first, out.begin() + first + (size_t)overwritten);
+	}
+}
+
+profiler::profiler() : start(std::chrono::steady_clock::now()) {
+
+}
+
+profile_buffer& profiler::buffer() {
+	thread_local profile_buffer* thread_buffer = nullptr;
+	if (!thread_buffer) {
+		std::lock_guard<std::mutex> lock(mutex);
+		buffers.push_back(std::make_unique<profile_buffer>());
+		thread_buffer = buffers.back().get();
+		thread_buffer->thread = (int)buffers.size() - 1;
+	}
+	return *thread_buffer;
+}
+
+void profiler::count(const profile_counters& counters) {
+	const uint64_t time = now();
+	profile_buffer& thread_buffer = buffer();
+	for (uint8_t i = 0; i < COUNTER_COUNT; i++) {
+		thread_buffer.push({ time, counters.values[i], (uint8_t)(ZONE_COUNT + i) });
+	}
+}
+
+std::string profiler::summary(const profile_counters& counters) {
+	uint64_t totals[ZONE_COUNT] = {};
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& thread_buffer : buffers) {
+			for (int zone = 0; zone < ZONE_COUNT; zone++) {
+				totals[zone] += thread_buffer->zone_totals[zone].load(std::memory_order_relaxed);
+			}
+		}
+	}
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	for (int zone = 0; zone < ZONE_COUNT; zone++) {
+		const double ms = (double)(totals[zone] - last_totals[zone]) / 1.0e6;
+		average_ms[zone] += (ms - average_ms[zone]) * 0.1;
+		last_totals[zone] = totals[zone];
+		out << "\n" << zone_names[zone] << ": " << average_ms[zone] << " ms";
+	}
+	const uint64_t* values = counters.values;
+	out << "\n" << counter_names[COUNTER_MOVES] << ": " << values[COUNTER_MOVES] << " of " << values[COUNTER_MOVES_TRIED];
+	for (int counter = COUNTER_HUNTS; counter < COUNTER_COUNT; counter++) {
+		out << "\n" << counter_names[counter] << ": " << values[counter];
+	}
+	return out.str();
+}
+
+bool profiler::write_chrome_trace(const std::string& path) {
+	std::ofstream file(path);
+	if (!file) {
+		return false;
+	}
+	std::vector<std::pair<int, std::vector<profile_event>>> threads;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& thread_buffer : buffers) {
+			threads.emplace_back(thread_buffer->thread, std::vector<profile_event>());
+			thread_buffer->read(threads.back().second);
+		}
+	}
+	// The times are in microseconds.
+	file << std::fixed << std::setprecision(3);
+	file << "{\"traceEvents\":[";
+	bool first = true;
+	for (auto& [thread, events] : threads) {
+		for (const profile_event& event : events) {
+			file << (first ? "\n" : ",\n");
+			first = false;
+			if (event.zone < ZONE_COUNT) {
+				file << "{\"name\":\"" << zone_names[event.zone] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+					<< ",\"ts\":" << (double)event.time / 1000.0 << ",\"dur\":" << (double)event.value / 1000.0 << "}";
+			} else {
+				file << "{\"name\":\"" << counter_names[event.zone - ZONE_COUNT] << "\",\"ph\":\"C\",\"pid\":1,\"tid\":" << thread
+					<< ",\"ts\":" << (double)event.time / 1000.0 << ",\"args\":{\"value\":" << event.value << "}}";
+			}
+		}
+	}
+	file << "\n]}\n";
+	return (bool)file;
+}
+
+profiler& get_profiler() {
+	static profiler instance;
+	return instance;
+}
@@ -1,175 +1,261 @@
 #include "psim.hpp"
-#include <engine.hpp>
-#include <memory.hpp>
-#include <platform.hpp>
+#include "checkpoint.hpp"
 #include <fstream>
-#include <bitset>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
 
-psim::psim() {
-	rng = std::mt19937_64(time(nullptr));
-	rng_direction = std::uniform_int_distribution<int>(0, 7);
-	
-	if (!std::experimental::filesystem::is_directory("stats")) {
-		std::experimental::filesystem::create_directory("stats");
-	}
+void sim_stats::animal_stats::add(const animal_stats& other) {
+	dead_from_hunger += other.dead_from_hunger;
+	born += other.born;
+	dead_from_age += other.dead_from_age;
+	dead_randomly += other.dead_randomly;
+}
+
+void sim_stats::take(sim_stats& other) {
+	bears.add(other.bears);
+	seals.add(other.seals);
+	seals_eaten_by_bears += other.seals_eaten_by_bears;
+	other.bears = {};
+	other.seals = {};
+	other.seals_eaten_by_bears = 0;
+}
+
+void animal_list::push(int cell, uint8_t age, float hunger, int birthday) {
+	cells.push_back(cell);
+	this->hunger.push_back(hunger);
+	this->age.push_back(age);
+	direction.push_back(-1);
+	this->birthday.push_back(birthday);
+}
+
+void animal_list::append(const std::vector<int>& new_cells, uint8_t age, float hunger, int birthday) {
+	reserve(size() + new_cells.size());
+	cells.insert(cells.end(), new_cells.begin(), new_cells.end());
+	this->hunger.resize(cells.size(), hunger);
+	this->age.resize(cells.size(), age);
+	direction.resize(cells.size(), -1);
+	this->birthday.resize(cells.size(), birthday);
+}
 
-#if RECORD_ENABLED || REPLAY_ENABLED
-	if (WORLD_SIZE > 2048) {
-		NE_ERROR("Cannot have world size over 2048 when recording is enabled.");
-		std::exit(1);
+void animal_list::reserve(size_t count) {
+	if (count <= cells.capacity()) {
+		return;
 	}
-#endif
+	count = std::max(count, cells.capacity() * 2);
+	cells.reserve(count);
+	hunger.reserve(count);
+	age.reserve(count);
+	direction.reserve(count);
+	birthday.reserve(count);
+}
 
-	ani.create();
-	ani.pixels = new uint32[WORLD_SIZE * WORLD_SIZE];
-	ani.size = WORLD_SIZE;
-	memcpy(ani.pixels, textures.world.pixels, sizeof(uint32) * WORLD_SIZE * WORLD_SIZE);
-	ani.render();
-
-#if !REPLAY_ENABLED
-	cells.insert(cells.begin(), WORLD_SIZE * WORLD_SIZE, {});
-	for (int i = 0; i < INITIAL_BEAR_COUNT; i++) {
-		while (true) {
-			int x = ne::random_int(WORLD_SIZE - 1);
-			int y = ne::random_int(WORLD_SIZE - 1);
-			int j = x + y * WORLD_SIZE;
-			if (TERRAIN_AT(j) == WATER || cells[j].animal == BEAR) {
-				continue;
-			}
-			cells[j] = { -1, (uint8)ne::random_int(BEAR_MAX_AGE), ne::random_float(0.0f, 0.5f), BEAR};
-			bears.push_back(j);
-			ani.pixels[j] = BEAR;
-#if RECORD_ENABLED
-			replay.push(year, ticks, j, ani.pixels[j]);
-#endif
-			break;
-		}
+void animal_list::swap_and_pop(int slot) {
+	SWAP_AND_POP(cells, slot);
+	SWAP_AND_POP(hunger, slot);
+	SWAP_AND_POP(age, slot);
+	SWAP_AND_POP(direction, slot);
+	SWAP_AND_POP(birthday, slot);
+}
+
+psim::psim(const uint32_t* world_pixels, int world_size, const sim_params& params, uint64_t seed, int threads)
+	: psim(make_terrain_plane(world_pixels, world_size), world_size, params, seed, threads) {
+
+}
+
+psim::psim(terrain_plane terrain, int world_size, const sim_params& params, uint64_t seed, int threads)
+	: psim(terrain, make_terrain_cells(*terrain), world_size, params, seed, threads) {
+
+}
+
+psim::psim(terrain_plane terrain, terrain_cells cells, int world_size, const sim_params& params, uint64_t seed, int threads)
+	: params(params), world_size(world_size), terrain(terrain), world(terrain->data()), seed(seed), workers(std::max(threads, 1)) {
+	init();
+	place_animals(bears, ANIMAL_BEAR, params.bears, cells.ground);
+	place_animals(seals, ANIMAL_SEAL, params.seals, cells.water);
+	count_regions();
+}
+
+psim::psim(const checkpoint& from, int threads)
+	: psim(from, from.make_terrain(), from.params(), from.seed(), threads) {
+
+}
+
+psim::psim(const checkpoint& from, terrain_plane terrain, const sim_params& params, uint64_t seed, int threads)
+	: params(params), stats(from.stats()), year(from.header().year), ticks(from.header().ticks), new_year(from.header().new_year != 0),
+	world_size(from.header().world_size), terrain(terrain), world(terrain->data()), seed(seed), workers(std::max(threads, 1)) {
+	init();
+	std::copy(from.occupants(), from.occupants() + occupants.size(), occupants.begin());
+	from.read_animals(from.header().bears, bears);
+	from.read_animals(from.header().seals, seals);
+	for (size_t i = 0; i < seals.size(); i++) {
+		seal_slots.set((size_t)seals.cells[i], (int)i);
 	}
-	for (int i = 0; i < INITIAL_SEAL_COUNT; i++) {
-		while (true) {
-			int x = ne::random_int(WORLD_SIZE - 1);
-			int y = ne::random_int(WORLD_SIZE - 1);
-			int j = x + y * WORLD_SIZE;
-			if (TERRAIN_AT(j) != WATER || cells[j].animal != 0) {
-				continue;
+	// A fork with a different year length keeps the tick and the birthdays at the same point of the year,
+	// so every birthday still comes around, and the year goes on from where it was.
+	const int saved_ticks_per_year = from.header().ticks_per_year;
+	if (params.ticks_per_year != saved_ticks_per_year) {
+		ticks = (int)((int64_t)ticks * params.ticks_per_year / saved_ticks_per_year);
+		for (animal_list* list : { &bears, &seals }) {
+			for (int& birthday : list->birthday) {
+				birthday = (int)((int64_t)birthday * params.ticks_per_year / saved_ticks_per_year);
 			}
-			cells[j] = { -1, (uint8)ne::random_int(SEAL_MAX_AGE), ne::random_float(0.0f, 0.5f), SEAL};
-			seals.push_back(j);
-			ani.pixels[j] = SEAL;
-#if RECORD_ENABLED
-			replay.push(year, ticks, j, ani.pixels[j]);
-#endif
-			break;
 		}
 	}
-	ne::listen([&](ne::keyboard_key_message key) {
-		if (key.is_pressed) {
-			if (key.key == KEY_B) {
-				bb.refs = &bears;
-				bb.ref_i = ne::random_int(bears.size() - 1);
-			} else if (key.key == KEY_N) {
-				bb.refs = &seals;
-				bb.ref_i = ne::random_int(seals.size() - 1);
-			}
+	count_regions();
+}
+
+void psim::init() {
+	tick_workers.resize(workers.size());
+
+	tiles_per_row = std::max(2, (world_size / PARALLEL_TILE_SIZE) & ~1);
+	tile_of_coord.resize(world_size);
+	for (int i = 0; i < world_size; i++) {
+		tile_of_coord[i] = (int)((int64_t)i * tiles_per_row / world_size);
+	}
+	for (int y = 0; y < tiles_per_row; y++) {
+		for (int x = 0; x < tiles_per_row; x++) {
+			phase_tiles[(x & 1) | ((y & 1) << 1)].push_back(x + y * tiles_per_row);
 		}
-	});
-#if LOG_ENABLED
-	ne::listen([&](ne::keyboard_key_message key) {
-		if (key.is_pressed && key.key == KEY_0) {
-			const time_t t = time(nullptr) - 1520561000;
-			std::ofstream of(STRING("stats/deaths_" << t << ".csv"));
-			of << "Reason;Age;Hunger;Animal;Tick;\n";
-			for (auto& i : log.deaths) {
-				switch (i.reason) {
-				case LOG_DEATH_RANDOM: of << "Random;"; break;
-				case LOG_DEATH_EATEN: of << "Eaten;"; break;
-				case LOG_DEATH_STARVED: of << "Starved;"; break;
-				case LOG_DEATH_AGED: of << "Aged;"; break;
-				default: of << "Unknown;"; break;
-				}
-				of << (int)i.age << ";";
-				of << i.hunger << ";";
-				if (i.animal == BEAR) {
-					of << "Bear;";
-				} else if (i.animal == SEAL) {
-					of << "Seal;";
-				} else {
-					of << "Unknown;";
-				}
-				of << i.tick<< ";\n";
-			}
-			of = std::ofstream(STRING("stats/births_" << t << ".csv"));
-			of << "Animal;Tick;\n";
-			for (auto& i : log.births) {
-				if (i.animal == BEAR) {
-					of << "Bear;";
-				} else if (i.animal == SEAL) {
-					of << "Seal;";
-				} else {
-					of << "Unknown";
-				}
-				of << i.tick << ";\n";
+	}
+	tile_offsets.resize(tiles_per_row * tiles_per_row + 1);
+	dirty_tiles_per_row = (world_size + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+	dirty_tiles.resize(dirty_tiles_per_row * dirty_tiles_per_row, 1);
+	tick_dirty_tiles.resize(dirty_tiles.size(), 0);
+	regions.resize(world_size, REGION_SIZE);
+	for (auto& worker : tick_workers) {
+		worker.dirty_tiles.resize(dirty_tiles.size(), 0);
+		worker.regions.resize(world_size, REGION_SIZE);
+	}
+
+	if (!std::filesystem::is_directory("stats")) {
+		std::filesystem::create_directory("stats");
+	}
+	occupants.resize((size_t)world_size * (size_t)world_size, ANIMAL_NONE);
+	seal_slots.resize(world_size, -1);
+	plan_capacity();
+}
+
+void psim::plan_capacity() {
+	const size_t cell_count = (size_t)world_size * (size_t)world_size;
+	for (auto [list, species] : { std::make_pair(&bears, &params.bears), std::make_pair(&seals, &params.seals) }) {
+		const size_t capacity = (species->capacity > 0 ? (size_t)species->capacity : (size_t)species->initial_count * CAPACITY_HEADROOM);
+		list->reserve(std::min(capacity, cell_count));
+	}
+}
+
+void psim::place_animals(animal_list& list, uint8_t animal, const species_params& species, std::vector<int>& candidates) {
+	// A partial Fisher-Yates shuffle moves the drawn cells to the front, so no draw is ever thrown away.
+	const size_t count = std::min((size_t)std::max(species.initial_count, 0), candidates.size());
+	if (count == 0) {
+		return;
+	}
+	random_stream random(seed, RANDOM_STREAM_SETUP, animal, 0);
+	for (size_t i = 0; i < count; i++) {
+		std::swap(candidates[i], candidates[i + (size_t)random.next_int((int)(candidates.size() - i))]);
+	}
+	list.cells.assign(candidates.begin(), candidates.begin() + count);
+	list.hunger.resize(count);
+	list.age.resize(count);
+	list.direction.assign(count, -1);
+	list.birthday.resize(count);
+
+	// The rest is split between the workers. Each animal's draws are at its own counters, so the result
+	// does not depend on how it is split.
+	const random_stream draws(seed, RANDOM_STREAM_SETUP, animal, 1);
+	workers.run([&](int worker) {
+		const size_t end = count * (size_t)(worker + 1) / (size_t)workers.size();
+		for (size_t i = count * (size_t)worker / (size_t)workers.size(); i < end; i++) {
+			random_stream random = draws;
+			random.counter = i * 3;
+			const int cell_i = list.cells[i];
+			ANIMAL_AT(cell_i) = animal;
+			if (animal == ANIMAL_SEAL) {
+				seal_slots.set((size_t)cell_i, (int)i);
 			}
+			list.age[i] = (uint8_t)random.next_int(species.max_age + 1);
+			list.hunger[i] = random.next_float(0.0f, 0.5f);
+			list.birthday[i] = random.next_int(params.ticks_per_year);
 		}
 	});
-#endif
-#endif
-	ne::listen([&](ne::keyboard_key_message key) {
-		if (!key.is_pressed) {
-			return;
-		}
-		if (key.key == KEY_O) {
-#if RECORD_ENABLED
-			ne::memory_buffer buffer;
-			buffer.write_uint32(replay.years.size());
-			for (auto& i : replay.years) {
-				for (auto& j : i.ticks) {
-					buffer.write_uint32(j.cells.size());
-					for (auto& k : j.cells) {
-						// TODO: Remove duplicates that are overwritten
-						uint32 data = (k.index | (k.pixel << 2));
-						buffer.write_uint8(data >> 16);
-						buffer.write_uint8(data >> 8);
-						buffer.write_uint8(data);
-					}
-				}
-			}
-			const time_t t = time(nullptr) - 1520561000;
-			ne::write_file(STRING("stats/" << t << ".re"), buffer.begin, buffer.write_index());
-			buffer.free();
-#endif
-		} else if (key.key == KEY_P) {
-#if REPLAY_ENABLED
-			if (!ne::file_exists(LOAD_REPLAY)) {
-				return;
-			}
-			ne::memory_buffer buffer;
-			ne::read_file(LOAD_REPLAY, &buffer);
-			for (size_t i = 0; i < WORLD_SIZE * WORLD_SIZE; i++) {
-				replay.push(year, ticks, i, ani.pixels[i]);
-			}
-			uint32 year_count = buffer.read_uint32();
-			for (uint32 i = 0; i < year_count; i++) {
-				replay.years.push_back({});
-				for (uint32 j = 0; j < TICKS_PER_YEAR; j++) {
-					uint32 cell_count = buffer.read_uint32();
-					for (uint32 k = 0; k < cell_count; k++) {
-						uint8 b0 = buffer.read_uint8();
-						uint8 b1 = buffer.read_uint8();
-						uint8 b2 = buffer.read_uint8();
-						uint32_t data = (b0 << 16) | (b1 << 8) | b2;
-						replay.years[i].ticks[j].cells.push_back({ data & ((1 << 2) - 1), data >> 2 });
-					}
-				}
-			}
-			buffer.free();
-#endif
+}
+
+void psim::count_regions() {
+	std::fill(regions.bears.begin(), regions.bears.end(), 0);
+	std::fill(regions.seals.begin(), regions.seals.end(), 0);
+	for (auto [list, counts] : { std::make_pair(&bears, &regions.bears), std::make_pair(&seals, &regions.seals) }) {
+		for (int cell_i : list->cells) {
+			(*counts)[(cell_i % world_size) / REGION_SIZE + (cell_i / world_size) / REGION_SIZE * regions.per_row]++;
 		}
-	});
+	}
+}
+
+psim::~psim() {
+	close_event_log();
+	close_replay();
+	close_region_log();
+}
+
+bool psim::open_event_log(const std::string& path) {
+	close_event_log();
+	if (!events.open(path, (int)tick_workers.size())) {
+		return false;
+	}
+	for (auto& worker : tick_workers) {
+		worker.events = { &events, events.take() };
+	}
+	return true;
+}
+
+void psim::close_event_log() {
+	if (!events.is_open()) {
+		return;
+	}
+	for (auto& worker : tick_workers) {
+		events.submit(worker.events.block);
+		worker.events = {};
+	}
+	events.close();
+}
+
+bool psim::open_replay(const std::string& path, int keyframe_interval) {
+	if (!replay.open(path, world_size, params.ticks_per_year, keyframe_interval > 0 ? keyframe_interval : params.ticks_per_year, world)) {
+		return false;
+	}
+	replay.write(ticks, occupants.data(), tick_dirty_tiles, dirty_tiles_per_row, DIRTY_TILE_SIZE);
+	return true;
+}
+
+void psim::close_replay() {
+	replay.close();
+}
+
+bool psim::open_region_log(const std::string& path) {
+	if (!region_log.open(path, world_size, regions, params.ticks_per_year)) {
+		return false;
+	}
+	region_log.write(ticks, regions);
+	return true;
+}
+
+void psim::close_region_log() {
+	if (region_log.is_open() && region_log.last_tick() != ticks) {
+		region_log.write(ticks, regions);
+	}
+	region_log.close();
 }
 
+// For the power of two sizes, the neighbours wrap around the world by masking, without branches.
+template<int SIZE>
 void psim::look(int index, look_info& info) {
 	info.coord = { index % WORLD_SIZE, index / WORLD_SIZE };
+	if constexpr (SIZE != 0 && (SIZE & (SIZE - 1)) == 0) {
+		info.left_x = (info.coord.x - 1) & (SIZE - 1);
+		info.top_y = (info.coord.y - 1) & (SIZE - 1);
+		info.right_x = (info.coord.x + 1) & (SIZE - 1);
+		info.bottom_y = (info.coord.y + 1) & (SIZE - 1);
+		return;
+	}
 	info.left_x = info.coord.x - 1;
 	info.top_y = info.coord.y - 1;
 	info.right_x = info.coord.x + 1;
@@ -186,364 +272,597 @@ void psim::look(int index, look_info& info) {
 	}
 }
 
-bool psim::try_move(int ref_i, int x, int y, uint32 terrain) {
+// The column and row of each direction around a cell, where 0 is left or above and 2 is right or below.
+static const int direction_column[8] = { 0, 1, 2, 0, 2, 0, 1, 2 };
+static const int direction_row[8] = { 0, 0, 0, 1, 1, 2, 2, 2 };
+
+template<int SIZE>
+int psim::neighbour(const look_info& info, int direction) const {
+	const int columns[3] = { info.left_x, info.coord.x, info.right_x };
+	const int rows[3] = { info.top_y, info.coord.y, info.bottom_y };
+	return columns[direction_column[direction]] + rows[direction_row[direction]] * WORLD_SIZE;
+}
+
+// The byte of the plane at each neighbour of the cell, with the first direction in the lowest byte.
+// Unless the world wraps around between them, the three cells of a row are next to each other.
+template<int SIZE>
+uint64_t psim::gather(const uint8_t* plane, const look_info& info) const {
+	const uint8_t* above = plane + (size_t)info.top_y * WORLD_SIZE;
+	const uint8_t* beside = plane + (size_t)info.coord.y * WORLD_SIZE;
+	const uint8_t* below = plane + (size_t)info.bottom_y * WORLD_SIZE;
+	if (info.left_x < info.right_x) {
+		above += info.left_x;
+		beside += info.left_x;
+		below += info.left_x;
+		return (uint64_t)above[0] | (uint64_t)above[1] << 8 | (uint64_t)above[2] << 16
+			| (uint64_t)beside[0] << 24 | (uint64_t)beside[2] << 32
+			| (uint64_t)below[0] << 40 | (uint64_t)below[1] << 48 | (uint64_t)below[2] << 56;
+	}
+	return (uint64_t)above[info.left_x] | (uint64_t)above[info.coord.x] << 8 | (uint64_t)above[info.right_x] << 16
+		| (uint64_t)beside[info.left_x] << 24 | (uint64_t)beside[info.right_x] << 32
+		| (uint64_t)below[info.left_x] << 40 | (uint64_t)below[info.coord.x] << 48 | (uint64_t)below[info.right_x] << 56;
+}
+
+// Neighbour masks have a bit per direction, in the order of RANDOM_DIRECTION. The 8 neighbours are
+// gathered into the bytes of a word, and compared all at once, so the kernels pick from the mask
+// instead of probing one cell at a time.
+template<int SIZE>
+uint8_t psim::free_neighbours(const look_info& info, uint8_t terrain) const {
+	return zero_bytes(gather<SIZE>(occupants.data(), info) | (gather<SIZE>(world, info) ^ BYTE_LANES(terrain)));
+}
+
+template<int SIZE>
+uint8_t psim::animal_neighbours(const look_info& info, uint8_t animal) const {
+	return zero_bytes(gather<SIZE>(occupants.data(), info) ^ BYTE_LANES(animal));
+}
+
+template<int SIZE>
+bool psim::try_move(tick_worker& worker, int ref_i, int x, int y, uint8_t terrain) {
 	const int move_index = x + y * WORLD_SIZE;
-	if (TERRAIN_AT(move_index) == terrain && cells[move_index].animal == 0) {
-		int& cell_i = (*animals)[ref_i];
-		ani.pixels[cell_i] = TERRAIN_AT(cell_i);
-		std::swap(cells[move_index], cells[cell_i]);
-		ani.pixels[move_index] = cells[move_index].animal;
-#if RECORD_ENABLED
-		replay.push(year, ticks, cell_i, ani.pixels[cell_i]);
-		replay.push(year, ticks, move_index, ani.pixels[move_index]);
-#endif
+	PROFILE_COUNT(worker.counters, COUNTER_MOVES_TRIED);
+	PROFILE_COUNT(worker.counters, COUNTER_CELLS_PROBED);
+	if (TERRAIN_AT(move_index) == terrain && ANIMAL_AT(move_index) == ANIMAL_NONE) {
+		PROFILE_COUNT(worker.counters, COUNTER_MOVES);
+		int& cell_i = animals->cells[ref_i];
+		ANIMAL_AT(move_index) = ANIMAL_AT(cell_i);
+		ANIMAL_AT(cell_i) = ANIMAL_NONE;
+		if (ANIMAL_AT(move_index) == ANIMAL_SEAL) {
+			seal_slots.set(x, y, ref_i);
+		}
+		const int from_region = REGION_OF(cell_i);
+		const int to_region = x / REGION_SIZE + y / REGION_SIZE * regions.per_row;
+		if (from_region != to_region) {
+			std::vector<int>& counts = REGION_COUNTS(worker.regions, ANIMAL_AT(move_index));
+			counts[from_region]--;
+			counts[to_region]++;
+		}
+		MARK_DIRTY(worker.dirty_tiles, cell_i);
+		MARK_DIRTY(worker.dirty_tiles, move_index);
 		cell_i = move_index;
 		return true;
 	}
 	return false;
 }
 
-bool psim::move(int ref_i, look_info& info, uint32 terrain, int direction) {
+template<int SIZE>
+bool psim::move(tick_worker& worker, int ref_i, look_info& info, uint8_t terrain, int direction) {
 	switch (direction) {
-	case 0: return try_move(ref_i, info.left_x, info.top_y, terrain);
-	case 1: return try_move(ref_i, info.coord.x, info.top_y, terrain);
-	case 2: return try_move(ref_i, info.right_x, info.top_y, terrain);
-	case 3: return try_move(ref_i, info.left_x, info.coord.y, terrain);
-	case 4: return try_move(ref_i, info.right_x, info.coord.y, terrain);
-	case 5: return try_move(ref_i, info.left_x, info.bottom_y, terrain);
-	case 6: return try_move(ref_i, info.coord.x, info.bottom_y, terrain);
-	case 7: return try_move(ref_i, info.right_x, info.bottom_y, terrain);
+	case 0: return try_move<SIZE>(worker, ref_i, info.left_x, info.top_y, terrain);
+	case 1: return try_move<SIZE>(worker, ref_i, info.coord.x, info.top_y, terrain);
+	case 2: return try_move<SIZE>(worker, ref_i, info.right_x, info.top_y, terrain);
+	case 3: return try_move<SIZE>(worker, ref_i, info.left_x, info.coord.y, terrain);
+	case 4: return try_move<SIZE>(worker, ref_i, info.right_x, info.coord.y, terrain);
+	case 5: return try_move<SIZE>(worker, ref_i, info.left_x, info.bottom_y, terrain);
+	case 6: return try_move<SIZE>(worker, ref_i, info.coord.x, info.bottom_y, terrain);
+	case 7: return try_move<SIZE>(worker, ref_i, info.right_x, info.bottom_y, terrain);
 	default: return false;
 	}
 }
 
-bool psim::try_birth(int cell_i, int x, int y, uint32 terrain) {
-	const int birth_index = x + y * WORLD_SIZE;
-	if (TERRAIN_AT(birth_index) == terrain && cells[birth_index].animal == 0) {
-		cells[birth_index] = { -1, 0, 0.0f, cells[cell_i].animal };
-		ani.pixels[birth_index] = cells[cell_i].animal;
-#if LOG_ENABLED
-		log.birth(cells[birth_index].animal, ticks);
-#endif
-#if RECORD_ENABLED
-		replay.push(year, ticks, birth_index, ani.pixels[birth_index]);
-#endif
-		to_add->push_back(birth_index);
-		stats.animals->born++;
-		return true;
-	}
-	return false;
+template<int SIZE>
+void psim::give_birth(tick_worker& worker, int cell_i, int birth_index) {
+	PROFILE_COUNT(worker.counters, COUNTER_BIRTHS);
+	ANIMAL_AT(birth_index) = ANIMAL_AT(cell_i);
+	MARK_DIRTY(worker.dirty_tiles, birth_index);
+	worker.events.birth(ANIMAL_AT(birth_index), ticks);
+	worker.born.push_back(birth_index);
+	REGION_COUNTS(worker.regions, ANIMAL_AT(birth_index))[REGION_OF(birth_index)]++;
+	worker.stats.animals->born++;
 }
 
-int psim::can_breed(float chance, int amount) {
-	if (!ne::random_chance(chance)) {
+int psim::can_breed(tick_worker& worker, float chance, int amount) {
+	if (!worker.random.chance(chance)) {
 		return 0;
 	}
-	return 1 + ne::random_int(amount - 1);
+	return 1 + worker.random.next_int(amount);
 }
 
-void psim::breed(int cell_i, look_info& info, int amount, uint32 terrain) {
-	for (int i = 0; i < amount; i++) {
-		if (try_birth(cell_i, info.left_x, info.top_y, terrain)) continue;
-		if (try_birth(cell_i, info.coord.x, info.top_y, terrain)) continue;
-		if (try_birth(cell_i, info.right_x, info.top_y, terrain)) continue;
-		if (try_birth(cell_i, info.left_x, info.coord.y, terrain)) continue;
-		if (try_birth(cell_i, info.right_x, info.coord.y, terrain)) continue;
-		if (try_birth(cell_i, info.left_x, info.bottom_y, terrain)) continue;
-		if (try_birth(cell_i, info.coord.x, info.bottom_y, terrain)) continue;
-		if (try_birth(cell_i, info.right_x, info.bottom_y, terrain)) continue;
+// The young are placed on the first free neighbours, in the order of the directions.
+template<int SIZE>
+void psim::breed(tick_worker& worker, int cell_i, look_info& info, int amount, uint8_t terrain) {
+	PROFILE_COUNT(worker.counters, COUNTER_CELLS_PROBED);
+	uint32_t free = free_neighbours<SIZE>(info, terrain);
+	for (int i = 0; i < amount && free != 0; i++) {
+		give_birth<SIZE>(worker, cell_i, neighbour<SIZE>(info, lowest_bit(free)));
+		free &= free - 1;
 	}
 }
 
-bool psim::try_hunt(int cell_i, int x, int y) {
-	const int hunt_index = x + y * WORLD_SIZE;
-	if (cells[hunt_index].animal == SEAL) {
-		cells[cell_i].hunger /= 2.0f;
-		for (size_t i = 0; i < seals.size(); i++) {
-			if (seals[i] == hunt_index) {
-				SWAP_AND_POP(seals, i);
-				break;
-			}
-		}
-#if LOG_ENABLED
-		log.death(LOG_DEATH_EATEN, cells[hunt_index].age, cells[hunt_index].hunger, cells[hunt_index].animal, ticks);
-#endif
-		cells[hunt_index] = {};
-		ani.pixels[hunt_index] = TERRAIN_AT(hunt_index);
-#if RECORD_ENABLED
-		replay.push(year, ticks, hunt_index, ani.pixels[hunt_index]);
-#endif
-		stats.seals_eaten_by_bears++;
-		return true;
+template<int SIZE>
+void psim::eat(tick_worker& worker, int ref_i, int hunt_index) {
+	PROFILE_COUNT(worker.counters, COUNTER_HUNTS);
+	bears.hunger[ref_i] /= 2.0f;
+	const int slot = seal_slots.get(hunt_index % WORLD_SIZE, hunt_index / WORLD_SIZE);
+	worker.events.death(EVENT_DEATH_EATEN, seals.age[slot], seals.hunger[slot], ANIMAL_SEAL, ticks);
+	bury<SIZE>(worker, seals, slot);
+	worker.stats.seals_eaten_by_bears++;
+}
+
+// Eats the first seal next to the bear, in the order of the directions.
+template<int SIZE>
+bool psim::hunt(tick_worker& worker, int ref_i, look_info& info) {
+	PROFILE_COUNT(worker.counters, COUNTER_CELLS_PROBED);
+	const uint8_t prey = animal_neighbours<SIZE>(info, ANIMAL_SEAL);
+	if (prey == 0) {
+		return false;
 	}
-	return false;
+	eat<SIZE>(worker, ref_i, neighbour<SIZE>(info, lowest_bit(prey)));
+	return true;
 }
 
-bool psim::hunt(int cell_i, look_info& info) {
-	if (try_hunt(cell_i, info.left_x, info.top_y)) return true;
-	if (try_hunt(cell_i, info.coord.x, info.top_y)) return true;
-	if (try_hunt(cell_i, info.right_x, info.top_y)) return true;
-	if (try_hunt(cell_i, info.left_x, info.coord.y)) return true;
-	if (try_hunt(cell_i, info.right_x, info.coord.y)) return true;
-	if (try_hunt(cell_i, info.left_x, info.bottom_y)) return true;
-	if (try_hunt(cell_i, info.coord.x, info.bottom_y)) return true;
-	if (try_hunt(cell_i, info.right_x, info.bottom_y)) return true;
-	return false;
+// Marks the animal as dead during a pass. Its slot is released by finish_pass().
+template<int SIZE>
+void psim::bury(tick_worker& worker, animal_list& list, int ref_i) {
+	REGION_COUNTS(worker.regions, ANIMAL_AT(list.cells[ref_i]))[REGION_OF(list.cells[ref_i])]--;
+	ANIMAL_AT(list.cells[ref_i]) = ANIMAL_NONE;
+	MARK_DIRTY(worker.dirty_tiles, list.cells[ref_i]);
+	list.cells[ref_i] = -1;
+	(&list == &bears ? worker.dead_bears : worker.dead_seals).push_back(ref_i);
 }
 
-void psim::kill(int per_year) {
-	const float per_tick = (float)per_year / (float)TICKS_PER_YEAR;
+void psim::release(animal_list& list, int ref_i) {
+	list.swap_and_pop(ref_i);
+	if (&list == &seals && ref_i < (int)list.size()) {
+		seal_slots.set((size_t)list.cells[ref_i], ref_i);
+	}
+}
+
+template<int SIZE>
+void psim::remove(animal_list& list, int ref_i) {
+	REGION_COUNTS(regions, ANIMAL_AT(list.cells[ref_i]))[REGION_OF(list.cells[ref_i])]--;
+	ANIMAL_AT(list.cells[ref_i]) = ANIMAL_NONE;
+	MARK_DIRTY(tick_dirty_tiles, list.cells[ref_i]);
+	release(list, ref_i);
+}
+
+// How likely the animal is to be picked by kill() when it is drawn, from 0 to 1.
+// Crowding is counted over the eight neighbours, which are always up to date and cost one gather.
+template<int SIZE>
+float psim::kill_weight(int ref_i) {
+	float weight = 1.0f;
+	switch (species->kill_by) {
+	case KILL_AGE:
+		weight = std::min(1.0f, (float)(animals->age[ref_i] + 1) / (float)(species->max_age + 2));
+		break;
+	case KILL_HUNGER:
+		weight = std::clamp(animals->hunger[ref_i], KILL_MIN_WEIGHT, 1.0f);
+		break;
+	default:
+		break;
+	}
+	if (species->kill_crowding > 0.0f) {
+		const int cell_i = animals->cells[ref_i];
+		look_info info;
+		look<SIZE>(cell_i, info);
+		const float crowded = (float)bit_count(animal_neighbours<SIZE>(info, ANIMAL_AT(cell_i))) / 8.0f;
+		weight *= (1.0f + species->kill_crowding * crowded) / (1.0f + species->kill_crowding);
+	}
+	return weight;
+}
+
+// Removes dead_per_year animals a year, spread over the ticks. Each victim is drawn from the whole list
+// by rejection: a slot is drawn uniformly and kept with the chance kill_weight() gives it. The victims of
+// a tick therefore cost the same whatever the population, and removing one with a swap does not change
+// the odds of the rest.
+template<int SIZE>
+void psim::kill() {
+	PROFILE_SCOPE(ZONE_KILL);
+	const float per_tick = (float)species->dead_per_year / (float)params.ticks_per_year;
 	stats.animals->kill_chance += per_tick;
-	for (size_t i = 0; i < animals->size() && stats.animals->kill_chance >= 1.0f; i++) {
-		int cell_i = (*animals)[i];
-#if LOG_ENABLED
-		log.death(LOG_DEATH_RANDOM, cells[cell_i].age, cells[cell_i].hunger, cells[cell_i].animal, ticks);
-#endif
-		cells[cell_i] = {};
-		ani.pixels[cell_i] = TERRAIN_AT(cell_i);
-#if RECORD_ENABLED
-		replay.push(year, ticks, cell_i, ani.pixels[cell_i]);
-#endif
-		SWAP_AND_POP(*animals, i);
+	random_stream random(seed, RANDOM_STREAM_KILL, ticks, animals == &bears ? ANIMAL_BEAR : ANIMAL_SEAL);
+	while (animals->size() > 0 && stats.animals->kill_chance >= 1.0f) {
+		int ref_i = random.next_int((int)animals->size());
+		for (int tries = 1; tries < KILL_MAX_TRIES && !random.chance(kill_weight<SIZE>(ref_i)); tries++) {
+			ref_i = random.next_int((int)animals->size());
+		}
+		const int cell_i = animals->cells[ref_i];
+		tick_workers[0].events.death(EVENT_DEATH_RANDOM, animals->age[ref_i], animals->hunger[ref_i], ANIMAL_AT(cell_i), ticks);
+		remove<SIZE>(*animals, ref_i);
 		stats.animals->dead_randomly++;
 		stats.animals->kill_chance--;
 	}
 }
 
-void psim::update_bears() {
-	look_info info;
-	SET_ANIMAL(bears);
-	kill(BEARS_DEAD_PER_YEAR);
-	for (int ref_i = 0; ref_i < bears.size(); ref_i++) {
-		int& cell_i = bears[ref_i];
-		auto& bear = cells[cell_i];
-		look(cell_i, info);
-		bear.hunger += BEAR_HUNGER_RATE;
-		if (bear.hunger > 1.0f) {
-#if LOG_ENABLED
-			log.death(LOG_DEATH_STARVED, bear.age, bear.hunger, bear.animal, ticks);
-#endif
-			stats.bears.dead_from_hunger++;
-			bear = {};
-			ani.pixels[cell_i] = TERRAIN_AT(cell_i);
-#if RECORD_ENABLED
-			replay.push(year, ticks, cell_i, ani.pixels[cell_i]);
-#endif
-			SWAP_AND_POP(bears, ref_i);
-			ref_i--;
-			continue;
+// Groups the slots of the list by the tile their animal is in.
+template<int SIZE>
+void psim::bucket(const animal_list& list) {
+	PROFILE_SCOPE(ZONE_BUCKET);
+	std::fill(tile_offsets.begin(), tile_offsets.end(), 0);
+	for (size_t i = 0; i < list.size(); i++) {
+		const int cell_i = list.cells[i];
+		tile_offsets[tile_of_coord[cell_i % WORLD_SIZE] + tile_of_coord[cell_i / WORLD_SIZE] * tiles_per_row + 1]++;
+	}
+	for (size_t i = 1; i < tile_offsets.size(); i++) {
+		tile_offsets[i] += tile_offsets[i - 1];
+	}
+	tile_slots.resize(list.size());
+	std::vector<int>& next = scratch.next_slot;
+	next.assign(tile_offsets.begin(), tile_offsets.end() - 1);
+	for (size_t i = 0; i < list.size(); i++) {
+		const int cell_i = list.cells[i];
+		tile_slots[next[tile_of_coord[cell_i % WORLD_SIZE] + tile_of_coord[cell_i / WORLD_SIZE] * tiles_per_row]++] = (int)i;
+	}
+	for (int phase = 0; phase < 4; phase++) {
+		active_tiles[phase].clear();
+		phase_animals[phase] = 0;
+		for (int tile : phase_tiles[phase]) {
+			const int count = tile_offsets[tile + 1] - tile_offsets[tile];
+			if (count > 0) {
+				active_tiles[phase].push_back(tile);
+				phase_animals[phase] += count;
+			}
 		}
-		hunt(cell_i, info);
-		if (bear.direction == -1) {
-			bear.direction = RANDOM_DIRECTION;
+	}
+}
+
+// Calls update(worker, ref_i) for every animal in the last bucket(), one phase at a time.
+// Workers take the next tile as they finish one, so crowded tiles do not hold the rest back.
+// Only tiles with animals are handed out, and sparse phases are not handed out at all, so a world where
+// most of the map is empty, or where a species has died out, costs little more than its animals.
+template<typename Update>
+void psim::for_each_animal(Update update) {
+	for (int phase = 0; phase < 4; phase++) {
+		const std::vector<int>& tiles = active_tiles[phase];
+		if (tiles.empty()) {
+			continue;
 		}
-		if (bear.hunger > BEAR_HUNGER_HUNGRY) {
-			if (TERRAIN_AT(cell_i) == GROUND) {
-				if (move(ref_i, info, WATER, bear.direction)) {
-					bear.direction = -1;
-					continue;
+		std::atomic<size_t> next_tile = 0;
+		const std::function<void(int)> job = [&](int w) {
+			PROFILE_SCOPE(ZONE_TILES);
+			tick_worker& worker = tick_workers[w];
+			worker.ran = true;
+			for (size_t t = next_tile++; t < tiles.size(); t = next_tile++) {
+				const int tile = tiles[t];
+				for (int i = tile_offsets[tile]; i < tile_offsets[tile + 1]; i++) {
+					update(worker, tile_slots[i]);
 				}
 			}
-			if (move(ref_i, info, GROUND, bear.direction)) {
-				continue;
-			}
+		};
+		if (phase_animals[phase] < SERIAL_PHASE_ANIMALS) {
+			job(0);
+		} else {
+			workers.run(job);
+		}
+	}
+}
+
+// Releases the slots of animals that died and adds the animals born during the pass.
+void psim::finish_pass() {
+	PROFILE_SCOPE(ZONE_FINISH_PASS);
+	std::vector<int>& dead_bears = scratch.dead_bears;
+	std::vector<int>& dead_seals = scratch.dead_seals;
+	std::vector<int>& born = scratch.born;
+	dead_bears.clear();
+	dead_seals.clear();
+	born.clear();
+	for (auto& worker : tick_workers) {
+		if (!worker.ran) {
+			continue;
 		}
-		if (!move(ref_i, info, GROUND, bear.direction)) {
-			bear.direction = -1;
+		worker.ran = false;
+		dead_bears.insert(dead_bears.end(), worker.dead_bears.begin(), worker.dead_bears.end());
+		dead_seals.insert(dead_seals.end(), worker.dead_seals.begin(), worker.dead_seals.end());
+		born.insert(born.end(), worker.born.begin(), worker.born.end());
+		worker.dead_bears.clear();
+		worker.dead_seals.clear();
+		worker.born.clear();
+		for (size_t i = 0; i < tick_dirty_tiles.size(); i++) {
+			tick_dirty_tiles[i] |= worker.dirty_tiles[i];
 		}
+		std::fill(worker.dirty_tiles.begin(), worker.dirty_tiles.end(), 0);
+		regions.take(worker.regions);
+		stats.take(worker.stats);
+		counters.take(worker.counters);
 	}
-	if (new_year) {
-		for (int ref_i = 0; ref_i < bears.size(); ref_i++) {
-			int& cell_i = bears[ref_i];
-			auto& bear = cells[cell_i];
-			if (++bear.age >= BEAR_BREED_AGE) {
-				if (bear.age > BEAR_MAX_AGE) {
-#if LOG_ENABLED
-					log.death(LOG_DEATH_AGED, bear.age, bear.hunger, bear.animal, ticks);
-#endif
-					cells[cell_i] = {};
-					ani.pixels[cell_i] = TERRAIN_AT(cell_i);
-#if RECORD_ENABLED
-					replay.push(year, ticks, cell_i, ani.pixels[cell_i]);
-#endif
-					SWAP_AND_POP(bears, ref_i);
-					ref_i--;
-					stats.bears.dead_from_age++;
-					continue;
+	// Releasing from the highest slot down means the last animal is never one that is about to be released.
+	std::sort(dead_bears.begin(), dead_bears.end(), std::greater<int>());
+	for (int ref_i : dead_bears) {
+		release(bears, ref_i);
+	}
+	std::sort(dead_seals.begin(), dead_seals.end(), std::greater<int>());
+	for (int ref_i : dead_seals) {
+		release(seals, ref_i);
+	}
+	std::sort(born.begin(), born.end());
+	if (animals == &seals) {
+		for (size_t i = 0; i < born.size(); i++) {
+			seal_slots.set((size_t)born[i], (int)(seals.size() + i));
+		}
+	}
+	animals->append(born, 0, 0.0f, year_tick);
+}
+
+// The bookkeeping of every animal: hunger, age, and whether it starved or died of age, which only depends on
+// the animal itself and the terrain under it. The slots are taken in blocks. The first loop over a block has no
+// branches, so it vectorises, and the second collects the slots that died, which are then buried. The pass that
+// follows only sees the survivors.
+template<int SIZE>
+void psim::update_vitals() {
+	PROFILE_SCOPE(ZONE_VITALS);
+	animal_list& list = *animals;
+	const size_t count = list.size();
+	// Few animals are checked by the calling thread alone, like a sparse phase in for_each_animal().
+	const size_t parts = (count < SERIAL_PHASE_ANIMALS ? 1 : (size_t)workers.size());
+	const std::function<void(int)> job = [&](int w) {
+		tick_worker& worker = tick_workers[w];
+		worker.ran = true;
+		// The columns never overlap, which the compiler can not tell, since age is bytes.
+		float* __restrict hunger = list.hunger.data();
+		uint8_t* __restrict age = list.age.data();
+		const int* __restrict birthday = list.birthday.data();
+		const int* cells = list.cells.data(); // Not restrict, since bury() writes to it.
+		const float hunger_rate = species->hunger_rate;
+		const int breed_age = species->breed_age;
+		const int max_age = species->max_age;
+		const int tick_of_year = year_tick;
+		uint8_t ground[VITALS_BLOCK];
+		uint8_t fate[VITALS_BLOCK];
+		int dead[VITALS_BLOCK];
+		const size_t end = count * (size_t)(w + 1) / parts;
+		for (size_t block = count * (size_t)w / parts; block < end; block += VITALS_BLOCK) {
+			const int size = (int)std::min<size_t>(VITALS_BLOCK, end - block);
+			if (animals == &seals) {
+				// Seals only starve in the water, and only die of age on land, resting after they have eaten.
+				for (int j = 0; j < size; j++) {
+					ground[j] = (uint8_t)(TERRAIN_AT(cells[block + j]) == TERRAIN_GROUND);
 				}
-				int amount = can_breed(BEAR_BREED_PROBABILITY, 2);
-				if (amount > 0) {
-					look(cell_i, info);
-					breed(cell_i, info, amount, GROUND);
+				for (int j = 0; j < size; j++) {
+					const size_t i = block + j;
+					hunger[i] += hunger_rate;
+					age[i] += (uint8_t)(birthday[i] == tick_of_year);
+					const int starved = (ground[j] ^ 1) & (hunger[i] > 1.0f);
+					const int aged = ground[j] & (hunger[i] <= 0.1f) & (age[i] >= breed_age) & (age[i] > max_age);
+					fate[j] = (uint8_t)(starved * EVENT_DEATH_STARVED + aged * EVENT_DEATH_AGED);
 				}
+			} else {
+				// Bears only die of age on their birthday.
+				for (int j = 0; j < size; j++) {
+					const size_t i = block + j;
+					hunger[i] += hunger_rate;
+					const int aging = (birthday[i] == tick_of_year);
+					age[i] += (uint8_t)aging;
+					const int starved = (hunger[i] > 1.0f);
+					const int aged = (starved ^ 1) & aging & (age[i] >= breed_age) & (age[i] > max_age);
+					fate[j] = (uint8_t)(starved * EVENT_DEATH_STARVED + aged * EVENT_DEATH_AGED);
+				}
+			}
+			int dead_count = 0;
+			for (int j = 0; j < size; j++) {
+				dead[dead_count] = j;
+				dead_count += (fate[j] != 0);
+			}
+			for (int k = 0; k < dead_count; k++) {
+				const int ref_i = (int)block + dead[k];
+				const uint8_t reason = fate[dead[k]];
+				worker.events.death(reason, age[ref_i], hunger[ref_i], ANIMAL_AT(list.cells[ref_i]), ticks);
+				(reason == EVENT_DEATH_STARVED ? worker.stats.animals->dead_from_hunger : worker.stats.animals->dead_from_age)++;
+				bury<SIZE>(worker, list, ref_i);
 			}
 		}
+	};
+	if (parts == 1) {
+		job(0);
+	} else {
+		workers.run(job);
 	}
-	for (auto& i : bears_to_add) {
-		bears.push_back(i);
-	}
-	bears_to_add.clear();
+	finish_pass();
 }
 
-void psim::update_seals() {
+template<int SIZE>
+void psim::update_bear(tick_worker& worker, int ref_i) {
 	look_info info;
-	SET_ANIMAL(seals);
-	kill(SEALS_DEAD_PER_YEAR);
-	for (int ref_i = 0; ref_i < seals.size(); ref_i++) {
-		int& cell_i = seals[ref_i];
-		auto& seal = cells[cell_i];
-		look(cell_i, info);
-		seal.hunger += SEAL_HUNGER_RATE;
-		if (new_year) {
-			seal.age++;
-		}
-		if (TERRAIN_AT(cell_i) == GROUND) {
-			if (seal.hunger > 0.1f) {
-				seal.hunger -= 0.01f;
-			} else {
-				if (seal.age >= SEAL_BREED_AGE) {
-					if (seal.age > SEAL_MAX_AGE) {
-#if LOG_ENABLED
-						log.death(LOG_DEATH_AGED, seal.age, seal.hunger, seal.animal, ticks);
-#endif
-						cells[cell_i] = {};
-						ani.pixels[cell_i] = TERRAIN_AT(cell_i);
-#if RECORD_ENABLED
-						replay.push(year, ticks, cell_i, ani.pixels[cell_i]);
-#endif
-						SWAP_AND_POP(seals, ref_i);
-						ref_i--;
-						stats.seals.dead_from_age++;
-						continue;
-					}
-					int amount = can_breed(SEAL_BREED_PROBABILITY, 2);
-					if (amount > 0) {
-						breed(cell_i, info, amount, WATER);
-					}
-				}
-				if (move(ref_i, info, WATER, RANDOM_DIRECTION)) {
-					seal.hunger = 0.0f;
-					continue;
-				} else {
-					seal.hunger += 0.1f;
-				}
+	const int cell_i = bears.cells[ref_i];
+	worker.random = random_stream(seed, RANDOM_STREAM_BEARS, ticks, cell_i);
+	float& hunger = bears.hunger[ref_i];
+	int8_t& direction = bears.direction[ref_i];
+	look<SIZE>(cell_i, info);
+	hunt<SIZE>(worker, ref_i, info);
+	if (direction == -1) {
+		direction = RANDOM_DIRECTION;
+	}
+	// Nothing is written to the animal after a successful move. The cell data used to be swapped
+	// by try_move, which made such writes land on the vacated cell, and the presets are tuned for that.
+	if (hunger > params.bears.hunger_hungry) {
+		if (TERRAIN_AT(cell_i) == TERRAIN_GROUND) {
+			if (move<SIZE>(worker, ref_i, info, TERRAIN_WATER, direction)) {
+				return;
 			}
-			continue;
 		}
-		if (seal.hunger > 1.0f) {
-#if LOG_ENABLED
-			log.death(LOG_DEATH_STARVED, seal.age, seal.hunger, seal.animal, ticks);
-#endif
-			stats.seals.dead_from_hunger++;
-			seal = {};
-			ani.pixels[cell_i] = TERRAIN_AT(cell_i);
-#if RECORD_ENABLED
-			replay.push(year, ticks, cell_i, ani.pixels[cell_i]);
-#endif
-			SWAP_AND_POP(seals, ref_i);
-			ref_i--;
-			continue;
+		if (move<SIZE>(worker, ref_i, info, TERRAIN_GROUND, direction)) {
+			return;
 		}
-		if (seal.hunger > SEAL_HUNGER_HUNGRY) {
-			if (seal.direction == -1) {
-				seal.direction = RANDOM_DIRECTION;
-			}
-			if (move(ref_i, info, GROUND, seal.direction)) {
-				seal.direction = -1;
-				continue;
-			}
-			if (move(ref_i, info, WATER, seal.direction)) {
-				if (info.coord.x % (seal.age + 1) == 0 || info.coord.y % (seal.age + 1) == 0) {
-					seal.direction = RANDOM_DIRECTION;
+	}
+	if (!move<SIZE>(worker, ref_i, info, TERRAIN_GROUND, direction)) {
+		direction = -1;
+	}
+}
+
+template<int SIZE>
+void psim::breed_bear(tick_worker& worker, int ref_i) {
+	if (bears.age[ref_i] < params.bears.breed_age) {
+		return;
+	}
+	const int cell_i = bears.cells[ref_i];
+	worker.random = random_stream(seed, RANDOM_STREAM_BEARS_BREED, ticks, cell_i);
+	int amount = can_breed(worker, params.bears.breed_probability, 2);
+	if (amount > 0) {
+		look_info info;
+		look<SIZE>(cell_i, info);
+		breed<SIZE>(worker, cell_i, info, amount, TERRAIN_GROUND);
+	}
+}
+
+template<int SIZE>
+void psim::update_seal(tick_worker& worker, int ref_i) {
+	look_info info;
+	const int cell_i = seals.cells[ref_i];
+	worker.random = random_stream(seed, RANDOM_STREAM_SEALS, ticks, cell_i);
+	float& hunger = seals.hunger[ref_i];
+	uint8_t& age = seals.age[ref_i];
+	int8_t& direction = seals.direction[ref_i];
+	look<SIZE>(cell_i, info);
+	if (TERRAIN_AT(cell_i) == TERRAIN_GROUND) {
+		if (hunger > 0.1f) {
+			hunger -= 0.01f;
+		} else {
+			if (age >= params.seals.breed_age) {
+				int amount = can_breed(worker, params.seals.breed_probability, 2);
+				if (amount > 0) {
+					breed<SIZE>(worker, cell_i, info, amount, TERRAIN_WATER);
 				}
-				continue;
-			} else {
-				seal.direction = RANDOM_DIRECTION;
 			}
-		} else {
-			move(ref_i, info, WATER, RANDOM_DIRECTION);
-			continue;
+			if (!move<SIZE>(worker, ref_i, info, TERRAIN_WATER, RANDOM_DIRECTION)) {
+				hunger += 0.1f;
+			}
 		}
+		return;
 	}
-	for (auto& i : seals_to_add) {
-		seals.push_back(i);
+	if (hunger > params.seals.hunger_hungry) {
+		if (direction == -1) {
+			direction = RANDOM_DIRECTION;
+		}
+		if (move<SIZE>(worker, ref_i, info, TERRAIN_GROUND, direction)) {
+			return;
+		}
+		if (!move<SIZE>(worker, ref_i, info, TERRAIN_WATER, direction)) {
+			direction = RANDOM_DIRECTION;
+		}
+	} else {
+		move<SIZE>(worker, ref_i, info, TERRAIN_WATER, RANDOM_DIRECTION);
 	}
-	seals_to_add.clear();
 }
 
-void psim::update() {
-#if !SIM_AUTO
-	if (!ne::is_key_down(KEY_SPACE)) {
-		return;
+template<int SIZE>
+void psim::update_bears() {
+	SET_ANIMAL(bears);
+	{
+		TIME_SCOPE(timings.kill);
+		kill<SIZE>();
 	}
-#endif
+	TIME_SCOPE(timings.bears);
+	update_vitals<SIZE>();
+	bucket<SIZE>(bears);
+	{
+		PROFILE_SCOPE(ZONE_BEARS);
+		for_each_animal([this](tick_worker& worker, int ref_i) {
+			update_bear<SIZE>(worker, ref_i);
+			if (bears.birthday[ref_i] == year_tick) {
+				breed_bear<SIZE>(worker, ref_i);
+			}
+		});
+	}
+	finish_pass();
+}
+
+template<int SIZE>
+void psim::update_seals() {
+	SET_ANIMAL(seals);
+	{
+		TIME_SCOPE(timings.kill);
+		kill<SIZE>();
+	}
+	TIME_SCOPE(timings.seals);
+	update_vitals<SIZE>();
+	bucket<SIZE>(seals);
+	{
+		PROFILE_SCOPE(ZONE_SEALS);
+		for_each_animal([this](tick_worker& worker, int ref_i) {
+			update_seal<SIZE>(worker, ref_i);
+		});
+	}
+	finish_pass();
+}
+
+template<int SIZE>
+void psim::tick() {
+	update_bears<SIZE>();
+	update_seals<SIZE>();
+}
+
+void psim::update() {
+	PROFILE_SCOPE(ZONE_UPDATE);
+	counters = {};
 	int old_year = year;
-	year = ticks / TICKS_PER_YEAR;
+	year = ticks / params.ticks_per_year;
+	year_tick = ticks - year * params.ticks_per_year;
 	new_year = (old_year != year);
-#if REPLAY_ENABLED
-	replay_tick current_tick = replay.pop();
-	if (current_tick.cells.size() == 0) {
-		NE_WARNING_LIMIT("No more ticks in recording.", 1);
+	if (new_year && region_log.is_open()) {
+		region_log.write(ticks, regions);
 	}
-	for (auto& i : current_tick.cells) {
-		ani.pixels[i.index] = PIXEL_INDEX_TO_PIXEL(i.pixel);
+	DISPATCH(tick);
+	ticks++;
+	if (replay.is_open()) {
+		PROFILE_SCOPE(ZONE_REPLAY);
+		replay.write(ticks, occupants.data(), tick_dirty_tiles, dirty_tiles_per_row, DIRTY_TILE_SIZE);
 	}
-#else
-	update_bears();
-	update_seals();
+	for (size_t i = 0; i < dirty_tiles.size(); i++) {
+		dirty_tiles[i] |= tick_dirty_tiles[i];
+	}
+	std::fill(tick_dirty_tiles.begin(), tick_dirty_tiles.end(), 0);
+#if PROFILER_ENABLED
+	get_profiler().count(counters);
 #endif
-	ticks++;
 }
 
-void psim::draw() {
-	ne::shader::set_color(1.0f);
-	ne::transform3f transform;
-	transform.scale.xy = ani.size.to<float>();
-	ne::shader::set_transform(&transform);
-	ani.bind();
-	ani.refresh();
-	ne::drawing_shape::bound()->draw();
-#if !REPLAY_ENABLED
-	if (bb.refs && bb.ref_i != -1) {
-		if (bb.ref_i >= bb.refs->size() || bb.ref_i < 0) {
-			bb.ref_i = -1;
-			bb.refs = nullptr;
-			return;
-		}
-		int cell_i = (*bb.refs)[bb.ref_i];
-		if (cells[cell_i].animal == 0) {
-			bb.ref_i = -1;
-			bb.refs = nullptr;
-			return;
-		}
-		textures.blank.bind();
-		ne::shader::set_color({ 1.0f, 0.0f, 1.0f, 1.0f });
-		bb.transform.position.x = (float)(cell_i % WORLD_SIZE);
-		bb.transform.position.y = (float)(cell_i / WORLD_SIZE);
-		bb.transform.scale.xy = 1.0f;
-		ne::shader::set_transform(&bb.transform);
-		ne::drawing_shape::bound()->draw();
-		ne::ortho_camera::bound()->target = &bb.transform;
-		bb.info.font = &fonts.debug;
-		bool rendered = bb.info.render(STRING(
-			"Hunger: " << (int)(cells[cell_i].hunger * 100.0f) <<
-			"\nAge: " << (int)cells[cell_i].age
-		));
-		bb.info.transform.position = bb.transform.position;
-		if (rendered) {
-			bb.info.transform.scale.x /= 4.0f;
-			bb.info.transform.scale.y /= 4.0f;
+template<int SIZE>
+kernel_timings psim::time_kernels() {
+	const std::vector<uint8_t> saved_occupants = occupants;
+	const animal_list saved_bears = bears;
+	const animal_list saved_seals = seals;
+	tick_worker worker;
+	worker.dirty_tiles.resize(dirty_tiles.size(), 0);
+	worker.regions.resize(world_size, REGION_SIZE);
+	kernel_timings timings;
+	look_info info;
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < bears.size(); i++) {
+		look<SIZE>(bears.cells[i], info);
+		hunt<SIZE>(worker, (int)i, info);
+	}
+	timings.hunt = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (double)std::max<size_t>(1, bears.size());
+	occupants = saved_occupants;
+	bears = saved_bears;
+	seals = saved_seals;
+
+	// Every animal tries to have two young on its own terrain.
+	size_t breeds = 0;
+	start = std::chrono::steady_clock::now();
+	for (auto [list, list_stats] : { std::make_pair(&bears, &worker.stats.bears), std::make_pair(&seals, &worker.stats.seals) }) {
+		worker.stats.animals = list_stats;
+		for (int cell_i : list->cells) {
+			look<SIZE>(cell_i, info);
+			breed<SIZE>(worker, cell_i, info, 2, TERRAIN_AT(cell_i));
 		}
-		bb.info.transform.position.x -= bb.info.transform.scale.width / 2.0f;
-		bb.info.transform.position.y -= bb.info.transform.scale.height;
-		ne::shader::set_color({ 0.0f, 0.0f, 0.0f, 1.0f });
-		bb.info.draw();
-		bb.info.transform.position.x -= 0.25f;
-		bb.info.transform.position.y -= 0.25f;
-		ne::shader::set_color({ 1.0f, 0.0f, 1.0f, 1.0f });
-		bb.info.draw();
-	} else {
-		ne::ortho_camera::bound()->target = nullptr;
+		breeds += list->size();
 	}
-#endif
+	timings.breed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (double)std::max<size_t>(1, breeds);
+	occupants = saved_occupants;
+	return timings;
+}
+
+kernel_timings psim::time_kernels() {
+	kernel_timings timings;
+	DISPATCH(timings = time_kernels);
+	return timings;
 }
@@ -0,0 +1,328 @@
+#include "replay.hpp"
+#include "psim.hpp"
+#include <algorithm>
+#include <cstring>
+
+#define REPLAY_MAGIC        "PSRP"
+#define REPLAY_INDEX_MAGIC  "PSRI"
+#define REPLAY_VERSION      2
+
+#define FRAME_KEY           0
+#define FRAME_DELTA         1
+#define FRAME_INDEX         2
+
+static void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+static bool get_varint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && in < end; shift += 7) {
+		const uint8_t byte = *in++;
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool read_varint(std::ifstream& file, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		const int byte = file.get();
+		if (byte == EOF) {
+			return false;
+		}
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Cells must be in increasing order.
+static void encode_cells(std::vector<uint8_t>& payload, const std::vector<uint64_t>& cells, const uint8_t* occupants) {
+	payload.clear();
+	put_varint(payload, cells.size());
+	uint64_t previous = 0;
+	for (uint64_t cell : cells) {
+		put_varint(payload, ((cell - previous) << 2) | occupants[cell]);
+		previous = cell;
+	}
+}
+
+replay_writer::~replay_writer() {
+	close();
+}
+
+bool replay_writer::open(const std::string& path, int world_size, int ticks_per_year, int keyframe_interval, const uint8_t* terrain) {
+	close();
+	file.open(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	this->world_size = world_size;
+	this->keyframe_interval = std::max(1, keyframe_interval);
+	const size_t cell_count = (size_t)world_size * (size_t)world_size;
+	const uint32_t header[4] = { REPLAY_VERSION, (uint32_t)world_size, (uint32_t)ticks_per_year, (uint32_t)this->keyframe_interval };
+	std::vector<uint8_t> terrain_bits((cell_count + 7) / 8);
+	for (size_t i = 0; i < cell_count; i++) {
+		terrain_bits[i / 8] |= (terrain[i] == TERRAIN_WATER ? 1 : 0) << (i % 8);
+	}
+	file.write(REPLAY_MAGIC, 4);
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)terrain_bits.data(), terrain_bits.size());
+	offset = 4 + sizeof(header) + terrain_bits.size();
+	previous.assign(cell_count, ANIMAL_NONE);
+	keyframes.clear();
+	has_frame = false;
+	return true;
+}
+
+void replay_writer::close() {
+	if (!file.is_open()) {
+		return;
+	}
+	const uint64_t index_offset = offset;
+	payload.clear();
+	put_varint(payload, keyframes.size());
+	for (auto& keyframe : keyframes) {
+		put_varint(payload, (uint64_t)keyframe.first);
+		put_varint(payload, keyframe.second);
+	}
+	write_frame(FRAME_INDEX, 0);
+	file.write((const char*)&index_offset, sizeof(index_offset));
+	file.write(REPLAY_INDEX_MAGIC, 4);
+	file.close();
+	previous = {};
+}
+
+void replay_writer::write_frame(uint8_t type, int tick) {
+	std::vector<uint8_t> header;
+	header.push_back(type);
+	put_varint(header, (uint64_t)tick);
+	put_varint(header, payload.size());
+	file.write((const char*)header.data(), header.size());
+	file.write((const char*)payload.data(), payload.size());
+	offset += header.size() + payload.size();
+}
+
+void replay_writer::write(int tick, const uint8_t* occupants, const std::vector<uint8_t>& dirty_tiles, int dirty_tiles_per_row, int dirty_tile_size) {
+	cells.clear();
+	if (!has_frame || tick % keyframe_interval == 0) {
+		for (size_t i = 0; i < previous.size(); i++) {
+			if (occupants[i] != ANIMAL_NONE) {
+				cells.push_back(i);
+			}
+		}
+		std::copy(occupants, occupants + previous.size(), previous.begin());
+		encode_cells(payload, cells, occupants);
+		keyframes.emplace_back(tick, offset);
+		write_frame(FRAME_KEY, tick);
+		has_frame = true;
+		return;
+	}
+	// Row by row, so the cells are found in increasing order.
+	for (int y = 0; y < world_size; y++) {
+		const uint8_t* dirty_row = dirty_tiles.data() + y / dirty_tile_size * dirty_tiles_per_row;
+		const size_t row = (size_t)y * (size_t)world_size;
+		for (int tile_x = 0; tile_x < dirty_tiles_per_row; tile_x++) {
+			if (!dirty_row[tile_x]) {
+				continue;
+			}
+			const size_t begin = row + tile_x * dirty_tile_size;
+			const size_t end = row + std::min((tile_x + 1) * dirty_tile_size, world_size);
+			if (memcmp(occupants + begin, previous.data() + begin, end - begin) == 0) {
+				continue;
+			}
+			for (size_t i = begin; i < end; i++) {
+				if (occupants[i] != previous[i]) {
+					previous[i] = occupants[i];
+					cells.push_back(i);
+				}
+			}
+		}
+	}
+	encode_cells(payload, cells, occupants);
+	write_frame(FRAME_DELTA, tick);
+}
+
+bool replay_reader::open(const std::string& path) {
+	file = std::ifstream(path, std::ios::binary);
+	char magic[4] = {};
+	uint32_t header[4] = {};
+	file.read(magic, 4);
+	file.read((char*)header, sizeof(header));
+	if (!file || memcmp(magic, REPLAY_MAGIC, 4) != 0 || header[0] != REPLAY_VERSION) {
+		return false;
+	}
+	world_size = (int)header[1];
+	ticks_per_year = (int)header[2];
+	keyframe_interval = (int)header[3];
+	const size_t cell_count = (size_t)world_size * (size_t)world_size;
+	std::vector<uint8_t> terrain_bits((cell_count + 7) / 8);
+	file.read((char*)terrain_bits.data(), terrain_bits.size());
+	if (!file) {
+		return false;
+	}
+	terrain.resize(cell_count);
+	for (size_t i = 0; i < cell_count; i++) {
+		terrain[i] = (terrain_bits[i / 8] >> (i % 8)) & 1 ? TERRAIN_WATER : TERRAIN_GROUND;
+	}
+	const uint64_t frames_begin = (uint64_t)file.tellg();
+	keyframes.clear();
+	current_tick = -1;
+	final_tick = -1;
+
+	// Use the index if the replay was closed properly.
+	uint64_t index_offset = 0;
+	file.seekg(-12, std::ios::end);
+	file.read((char*)&index_offset, sizeof(index_offset));
+	file.read(magic, 4);
+	uint8_t type = 0;
+	int tick = 0;
+	uint64_t size = 0;
+	if (file && memcmp(magic, REPLAY_INDEX_MAGIC, 4) == 0) {
+		file.seekg(index_offset);
+		if (read_frame_header(type, tick, size) && type == FRAME_INDEX && read_payload(size)) {
+			const uint8_t* in = payload.data();
+			const uint8_t* end = in + payload.size();
+			uint64_t count = 0;
+			get_varint(in, end, count);
+			for (uint64_t i = 0; i < count; i++) {
+				uint64_t keyframe_tick = 0;
+				uint64_t keyframe_offset = 0;
+				if (!get_varint(in, end, keyframe_tick) || !get_varint(in, end, keyframe_offset)) {
+					return false;
+				}
+				keyframes.emplace_back((int)keyframe_tick, keyframe_offset);
+			}
+			frames_end = index_offset;
+		}
+	}
+	file.clear();
+
+	// Scan the frames otherwise. This also finds the last tick, which the index does not hold.
+	// A frame that was cut short ends the replay.
+	file.seekg(0, std::ios::end);
+	const uint64_t file_size = (uint64_t)file.tellg();
+	const bool has_index = !keyframes.empty();
+	file.seekg(has_index ? keyframes.back().second : frames_begin);
+	while (true) {
+		const uint64_t frame_offset = (uint64_t)file.tellg();
+		if ((has_index && frame_offset >= frames_end) || !read_frame_header(type, tick, size) || type == FRAME_INDEX) {
+			break;
+		}
+		const uint64_t frame_end = (uint64_t)file.tellg() + size;
+		if (frame_end > file_size) {
+			break;
+		}
+		file.seekg(frame_end);
+		if (!has_index) {
+			if (type == FRAME_KEY) {
+				keyframes.emplace_back(tick, frame_offset);
+			}
+			frames_end = frame_end;
+		}
+		final_tick = tick;
+	}
+	file.clear();
+	file.seekg(frames_begin);
+	return !keyframes.empty();
+}
+
+int replay_reader::first_tick() const {
+	return keyframes.empty() ? -1 : keyframes.front().first;
+}
+
+int replay_reader::last_tick() const {
+	return final_tick;
+}
+
+bool replay_reader::read_frame_header(uint8_t& type, int& tick, uint64_t& size) {
+	const int byte = file.get();
+	uint64_t value = 0;
+	if (byte == EOF || !read_varint(file, value) || !read_varint(file, size)) {
+		return false;
+	}
+	type = (uint8_t)byte;
+	tick = (int)value;
+	return true;
+}
+
+bool replay_reader::read_payload(uint64_t size) {
+	payload.resize(size);
+	file.read((char*)payload.data(), size);
+	return (bool)file;
+}
+
+void replay_reader::apply_payload(std::vector<uint8_t>& occupants, std::vector<uint64_t>* changed) {
+	const uint8_t* in = payload.data();
+	const uint8_t* end = in + payload.size();
+	uint64_t count = 0;
+	uint64_t cell = 0;
+	get_varint(in, end, count);
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t value = 0;
+		if (!get_varint(in, end, value)) {
+			return;
+		}
+		cell += value >> 2;
+		if (cell >= occupants.size()) {
+			return;
+		}
+		const uint8_t occupant = (uint8_t)(value & 3);
+		if (changed && occupants[cell] != occupant) {
+			changed->push_back(cell);
+		}
+		occupants[cell] = occupant;
+	}
+}
+
+bool replay_reader::next(std::vector<uint8_t>& occupants, std::vector<uint64_t>& changed) {
+	uint8_t type = 0;
+	int tick = 0;
+	uint64_t size = 0;
+	if ((uint64_t)file.tellg() >= frames_end || !read_frame_header(type, tick, size) || type == FRAME_INDEX || !read_payload(size)) {
+		file.clear();
+		return false;
+	}
+	occupants.resize((size_t)world_size * (size_t)world_size, ANIMAL_NONE);
+	if (type == FRAME_KEY) {
+		std::vector<uint8_t> keyframe(occupants.size(), ANIMAL_NONE);
+		apply_payload(keyframe, nullptr);
+		for (size_t i = 0; i < keyframe.size(); i++) {
+			if (keyframe[i] != occupants[i]) {
+				changed.push_back(i);
+			}
+		}
+		occupants.swap(keyframe);
+	} else {
+		apply_payload(occupants, &changed);
+	}
+	current_tick = tick;
+	return true;
+}
+
+bool replay_reader::seek(int tick, std::vector<uint8_t>& occupants) {
+	if (tick < first_tick() || tick > last_tick()) {
+		return false;
+	}
+	auto keyframe = std::upper_bound(keyframes.begin(), keyframes.end(), std::make_pair(tick, UINT64_MAX)) - 1;
+	file.clear();
+	file.seekg(keyframe->second);
+	std::vector<uint64_t> changed;
+	do {
+		changed.clear();
+		if (!next(occupants, changed) || current_tick > tick) {
+			return false;
+		}
+	} while (current_tick != tick);
+	return true;
+}
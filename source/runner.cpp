@@ -0,0 +1,178 @@
+#include "runner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#define SNAPSHOT_FRESH 4
+
+sim_runner::sim_runner(psim& sim) : sim(sim) {
+	const size_t tile_count = sim.dirty_tiles.size();
+	for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+		slots[i].occupants = sim.occupants;
+		slots[i].density.resize(sim.world_size);
+		uncounted[i].resize(tile_count, 1);
+		for (auto& changed : slots[i].changed_since) {
+			changed.resize(tile_count, 0);
+		}
+		changed_since[i].resize(tile_count, 0);
+	}
+	std::fill(sim.dirty_tiles.begin(), sim.dirty_tiles.end(), 0);
+	thread = std::thread([this] {
+		run();
+	});
+}
+
+sim_runner::~sim_runner() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		running = false;
+	}
+	run_condition.notify_one();
+	thread.join();
+}
+
+void sim_runner::set_running(bool running) {
+	std::unique_lock<std::mutex> lock(mutex);
+	this->running = running;
+	if (running) {
+		run_condition.notify_one();
+	} else {
+		idle_condition.wait(lock, [this] {
+			return idle;
+		});
+	}
+}
+
+void sim_runner::set_rate(int ticks_per_second) {
+	rate = std::max(0, ticks_per_second);
+}
+
+void sim_runner::paused(const std::function<void()>& edit) {
+	const bool was_running = is_running();
+	set_running(false);
+	edit();
+	set_running(was_running);
+}
+
+void sim_runner::follow(uint8_t animal, int slot) {
+	follow_slot = slot;
+	follow_animal = animal;
+}
+
+void sim_runner::run() {
+	using clock = std::chrono::steady_clock;
+	clock::time_point next_tick = clock::now();
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping) {
+		if (!running) {
+			// The last tick is handed over before going idle, even if the renderer had not taken the one before.
+			if (unpublished) {
+				lock.unlock();
+				publish();
+				lock.lock();
+			}
+			idle = true;
+			idle_condition.notify_all();
+			run_condition.wait(lock, [this] {
+				return running || stopping;
+			});
+			idle = false;
+			next_tick = clock::now();
+			continue;
+		}
+		lock.unlock();
+		sim.update();
+		collect_dirty_tiles();
+		unpublished = true;
+		if (!(middle_slot.load(std::memory_order_relaxed) & SNAPSHOT_FRESH)) {
+			publish();
+		}
+		const int ticks_per_second = rate;
+		if (ticks_per_second > 0) {
+			next_tick += std::chrono::nanoseconds(1000000000 / ticks_per_second);
+			const clock::time_point now = clock::now();
+			if (next_tick < now) {
+				next_tick = now; // Too far behind to catch up.
+			} else {
+				std::this_thread::sleep_until(next_tick);
+			}
+		}
+		lock.lock();
+	}
+	idle = true;
+	idle_condition.notify_all();
+}
+
+void sim_runner::collect_dirty_tiles() {
+	for (auto& changed : changed_since) {
+		for (size_t i = 0; i < changed.size(); i++) {
+			changed[i] |= sim.dirty_tiles[i];
+		}
+	}
+	std::fill(sim.dirty_tiles.begin(), sim.dirty_tiles.end(), 0);
+}
+
+void sim_runner::publish() {
+	collect_dirty_tiles();
+	unpublished = false;
+
+	// Bring the back slot up to date, one dirty tile row at a time.
+	sim_snapshot& snapshot = slots[back_slot];
+	std::vector<uint8_t>& stale = changed_since[back_slot];
+	const int per_row = sim.dirty_tiles_per_row;
+	for (int y = 0; y < sim.world_size; y++) {
+		const uint8_t* stale_row = stale.data() + y / DIRTY_TILE_SIZE * per_row;
+		const size_t row = (size_t)y * (size_t)sim.world_size;
+		for (int tile_x = 0; tile_x < per_row; tile_x++) {
+			if (stale_row[tile_x]) {
+				const size_t begin = row + tile_x * DIRTY_TILE_SIZE;
+				const size_t end = row + std::min((tile_x + 1) * DIRTY_TILE_SIZE, sim.world_size);
+				memcpy(snapshot.occupants.data() + begin, sim.occupants.data() + begin, end - begin);
+			}
+		}
+	}
+	std::vector<uint8_t>& uncounted_tiles = uncounted[back_slot];
+	for (size_t i = 0; i < stale.size(); i++) {
+		uncounted_tiles[i] |= stale[i];
+	}
+	snapshot.density_counted = count_density;
+	if (snapshot.density_counted) {
+		for (int tile_y = 0; tile_y < per_row; tile_y++) {
+			for (int tile_x = 0; tile_x < per_row; tile_x++) {
+				if (uncounted_tiles[tile_x + tile_y * per_row]) {
+					snapshot.density.recount(snapshot.occupants.data(), sim.world, tile_x * DIRTY_TILE_SIZE, tile_y * DIRTY_TILE_SIZE, DIRTY_TILE_SIZE);
+				}
+			}
+		}
+		std::fill(uncounted_tiles.begin(), uncounted_tiles.end(), 0);
+	}
+	for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+		snapshot.changed_since[i] = changed_since[i];
+	}
+	std::fill(stale.begin(), stale.end(), 0);
+
+	snapshot.ticks = sim.ticks;
+	snapshot.year = sim.year;
+	snapshot.bears = sim.bears.size();
+	snapshot.seals = sim.seals.size();
+	snapshot.stats = sim.stats;
+	snapshot.counters = sim.counters;
+	const int animal = follow_animal;
+	const int slot = follow_slot;
+	const animal_list& list = (animal == ANIMAL_BEAR ? sim.bears : sim.seals);
+	snapshot.followed = { (uint8_t)animal, slot };
+	if (animal != ANIMAL_NONE && slot >= 0 && slot < (int)list.size()) {
+		snapshot.followed = { (uint8_t)animal, slot, true, list.cells[slot], list.hunger[slot], list.age[slot] };
+	}
+	back_slot = middle_slot.exchange(back_slot | SNAPSHOT_FRESH, std::memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+}
+
+bool sim_runner::acquire() {
+	if (!(middle_slot.load(std::memory_order_relaxed) & SNAPSHOT_FRESH)) {
+		return false;
+	}
+	previous_front_slot = front_slot;
+	front_slot = middle_slot.exchange(front_slot, std::memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+	return true;
+}
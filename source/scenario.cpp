@@ -0,0 +1,156 @@
+#include "scenario.hpp"
+#include <fstream>
+#include <cstdlib>
+
+static sim_params make_preset(int bear_count, int bears_dead, float bear_breed, float bear_hungry, int seal_count, int seals_dead, float seal_breed) {
+	sim_params params;
+	params.bears = { bear_count, bears_dead, 30, 5, bear_breed, bear_hungry, 0.002f };
+	params.seals = { seal_count, seals_dead, 20, 3, seal_breed, 0.2f, 0.0005f };
+	return params;
+}
+
+bool find_preset(const std::string& name, sim_params& params) {
+	if (name == "balanced") {
+		params = make_preset(1000, 50, 0.3f, 0.4f, 100000, 3000, 0.15f);
+	} else if (name == "bears_die") {
+		params = make_preset(1000, 100, 0.2f, 0.5f, 100000, 3000, 0.15f);
+	} else if (name == "both_die") {
+		params = make_preset(1000, 50, 0.5f, 0.4f, 100000, 5000, 0.1f);
+	} else if (name == "stress_test") {
+		params = make_preset(10000, 50, 0.3f, 0.4f, 1000000, 3000, 0.15f);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static std::string trim(const std::string& string) {
+	const size_t first = string.find_first_not_of(" \t\r");
+	if (first == std::string::npos) {
+		return "";
+	}
+	return string.substr(first, string.find_last_not_of(" \t\r") - first + 1);
+}
+
+static bool parse_int(const std::string& value, int& out) {
+	char* end = nullptr;
+	const long result = strtol(value.c_str(), &end, 10);
+	if (value.empty() || *end != '\0') {
+		return false;
+	}
+	out = (int)result;
+	return true;
+}
+
+static bool parse_float(const std::string& value, float& out) {
+	char* end = nullptr;
+	const float result = strtof(value.c_str(), &end);
+	if (value.empty() || *end != '\0') {
+		return false;
+	}
+	out = result;
+	return true;
+}
+
+static bool parse_kill_by(const std::string& value, int& out) {
+	if (value == "uniform") {
+		out = KILL_UNIFORM;
+	} else if (value == "age") {
+		out = KILL_AGE;
+	} else if (value == "hunger") {
+		out = KILL_HUNGER;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static bool set_species_param(species_params& species, const std::string& key, const std::string& value) {
+	if (key == "initial_count") return parse_int(value, species.initial_count);
+	if (key == "dead_per_year") return parse_int(value, species.dead_per_year);
+	if (key == "max_age") return parse_int(value, species.max_age);
+	if (key == "breed_age") return parse_int(value, species.breed_age);
+	if (key == "breed_probability") return parse_float(value, species.breed_probability);
+	if (key == "hunger_hungry") return parse_float(value, species.hunger_hungry);
+	if (key == "hunger_rate") return parse_float(value, species.hunger_rate);
+	if (key == "kill_by") return parse_kill_by(value, species.kill_by);
+	if (key == "kill_crowding") return parse_float(value, species.kill_crowding);
+	if (key == "capacity") return parse_int(value, species.capacity);
+	return false;
+}
+
+bool set_param(sim_params& params, const std::string& key, const std::string& value) {
+	if (key.compare(0, 6, "bears.") == 0) {
+		return set_species_param(params.bears, key.substr(6), value);
+	}
+	if (key.compare(0, 6, "seals.") == 0) {
+		return set_species_param(params.seals, key.substr(6), value);
+	}
+	if (key == "preset") {
+		return find_preset(value, params);
+	}
+	if (key == "ticks_per_year") {
+		return parse_int(value, params.ticks_per_year);
+	}
+	return false;
+}
+
+static bool is_valid(const species_params& species) {
+	// Ages are stored in a byte.
+	return species.initial_count >= 0 && species.dead_per_year >= 0 && species.max_age >= 0 && species.max_age < 255 && species.breed_age >= 0
+		&& species.kill_by >= KILL_UNIFORM && species.kill_by <= KILL_HUNGER && species.kill_crowding >= 0.0f && species.capacity >= 0;
+}
+
+bool are_params_valid(const sim_params& params) {
+	return params.ticks_per_year > 0 && is_valid(params.bears) && is_valid(params.seals);
+}
+
+bool load_scenario(const std::string& path, sim_params& params, std::string& error) {
+	std::ifstream file(path);
+	if (!file) {
+		error = "Failed to open " + path;
+		return false;
+	}
+	std::string section;
+	std::string line;
+	int line_number = 0;
+	while (std::getline(file, line)) {
+		line_number++;
+		line = trim(line);
+		if (line.empty() || line[0] == '#' || line[0] == ';') {
+			continue;
+		}
+		const std::string where = path + ":" + std::to_string(line_number) + ": ";
+		if (line[0] == '[') {
+			section = trim(line.substr(1, line.find(']') - 1));
+			if (line.back() != ']' || (section != "bears" && section != "seals")) {
+				error = where + "Unknown section " + line;
+				return false;
+			}
+			continue;
+		}
+		const size_t equals = line.find('=');
+		if (equals == std::string::npos) {
+			error = where + "Expected key = value";
+			return false;
+		}
+		const std::string key = trim(line.substr(0, equals));
+		const std::string value = trim(line.substr(equals + 1));
+		if (!set_param(params, section.empty() ? key : section + "." + key, value)) {
+			error = where + "Invalid " + key + " = " + value;
+			return false;
+		}
+	}
+	if (!are_params_valid(params)) {
+		error = path + ": Parameters out of range";
+		return false;
+	}
+	return true;
+}
+
+bool load_scenario_or_preset(const std::string& name, sim_params& params, std::string& error) {
+	if (find_preset(name, params)) {
+		return true;
+	}
+	return load_scenario(name, params, error);
+}
@@ -0,0 +1,225 @@
+#include "psim.hpp"
+#include "checkpoint.hpp"
+#include "terrain.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// One parameter and the values it takes in the sweep.
+struct sweep_axis {
+	std::string key;
+	std::vector<std::string> values;
+};
+
+struct sweep_run {
+	int point = 0;     // Index of the combination of axis values.
+	int replicate = 0;
+	uint64_t seed = 0;
+	sim_params params;
+	std::string values; // The axis values, as CSV columns.
+};
+
+static void print_usage() {
+	printf("Usage: psim_sweep <world.png|world.raw|checkpoint.pscp> [--scenario preset|file.ini] [--vary key=a,b,c]... [--replicates R]\n");
+	printf("                  [--years N] [--seed S] [--jobs J] [--out prefix] [--quiet]\n");
+	printf("Keys are as in a scenario file, such as bears.breed_probability or seals.dead_per_year.\n");
+	printf("Every combination of the values is run R times, with the seeds S, S + 1, ..., S + R - 1.\n");
+	printf("Runs are forked from a checkpoint if one is given, and start from its scenario unless --scenario is given.\n");
+	printf("Writes prefix_runs.csv with one row per run, and prefix_years.csv with one row per run and year.\n");
+}
+
+static bool parse_axis(const char* arg, sweep_axis& axis) {
+	const char* equals = strchr(arg, '=');
+	if (!equals) {
+		return false;
+	}
+	axis.key = std::string(arg, equals - arg);
+	std::stringstream values(equals + 1);
+	std::string value;
+	while (std::getline(values, value, ',')) {
+		axis.values.push_back(value);
+	}
+	return !axis.values.empty();
+}
+
+static bool make_runs(const sim_params& base, const std::vector<sweep_axis>& axes, int replicates, uint64_t seed, std::vector<sweep_run>& runs) {
+	int points = 1;
+	for (auto& axis : axes) {
+		points *= (int)axis.values.size();
+	}
+	for (int point = 0; point < points; point++) {
+		sim_params params = base;
+		std::string values;
+		int rest = point;
+		for (auto& axis : axes) {
+			const std::string& value = axis.values[rest % axis.values.size()];
+			rest /= (int)axis.values.size();
+			if (!set_param(params, axis.key, value)) {
+				fprintf(stderr, "Invalid %s = %s\n", axis.key.c_str(), value.c_str());
+				return false;
+			}
+			values += value + ";";
+		}
+		if (!are_params_valid(params)) {
+			fprintf(stderr, "Parameters out of range: %s\n", values.c_str());
+			return false;
+		}
+		for (int replicate = 0; replicate < replicates; replicate++) {
+			runs.push_back({ point, replicate, seed + (uint64_t)replicate, params, values });
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		print_usage();
+		return 1;
+	}
+	const char* world_path = argv[1];
+	const char* scenario = nullptr;
+	std::vector<sweep_axis> axes;
+	int replicates = 1;
+	int years = 10;
+	uint64_t seed = 1;
+	int jobs = std::max(1, (int)std::thread::hardware_concurrency());
+	std::string out = "stats/sweep";
+	bool quiet = false;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+			scenario = argv[++i];
+		} else if (strcmp(argv[i], "--vary") == 0 && i + 1 < argc) {
+			sweep_axis axis;
+			if (!parse_axis(argv[++i], axis)) {
+				print_usage();
+				return 1;
+			}
+			axes.push_back(axis);
+		} else if (strcmp(argv[i], "--replicates") == 0 && i + 1 < argc) {
+			replicates = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--years") == 0 && i + 1 < argc) {
+			years = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+			jobs = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			out = argv[++i];
+		} else if (strcmp(argv[i], "--quiet") == 0) {
+			quiet = true;
+		} else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	// Every run forks from the checkpoint, so the years before it are only simulated once.
+	checkpoint from;
+	const bool fork = from.open(world_path);
+	sim_params base = fork ? from.params() : sim_params{};
+	std::string error;
+	if (scenario && !load_scenario_or_preset(scenario, base, error)) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	std::vector<sweep_run> runs;
+	if (!make_runs(base, axes, replicates, seed, runs)) {
+		return 1;
+	}
+
+	terrain_plane terrain;
+	terrain_cells cells;
+	int size = 0;
+	if (fork) {
+		terrain = from.make_terrain();
+		size = from.header().world_size;
+	} else if (!load_cached_terrain(world_path, terrain, cells, size)) {
+		fprintf(stderr, "Failed to load world map %s\n", world_path);
+		return 1;
+	}
+
+	std::ofstream runs_file(out + "_runs.csv");
+	std::ofstream years_file(out + "_years.csv");
+	if (!runs_file || !years_file) {
+		fprintf(stderr, "Failed to open %s_runs.csv or %s_years.csv\n", out.c_str(), out.c_str());
+		return 1;
+	}
+	std::string axis_columns;
+	for (auto& axis : axes) {
+		axis_columns += axis.key + ";";
+	}
+	runs_file << "Run;Point;Replicate;Seed;" << axis_columns << "Years;Bears;Seals;Bears extinct;Seals extinct;Seconds;\n";
+	years_file << "Run;Point;Replicate;Seed;" << axis_columns
+		<< "Year;Bears;Seals;Bears born;Seals born;Bears starved;Seals starved;Bears aged;Seals aged;Bears killed;Seals killed;Seals eaten;\n";
+
+	// Every run is a single threaded simulation, and the jobs take the next run as they finish one.
+	worker_pool pool(std::min(jobs, (int)runs.size()));
+	std::atomic<size_t> next_run = 0;
+	std::mutex output_mutex;
+	int finished = 0;
+	const auto start_time = std::chrono::steady_clock::now();
+	pool.run([&](int) {
+		for (size_t i = next_run++; i < runs.size(); i = next_run++) {
+			const sweep_run& run = runs[i];
+			const auto run_start_time = std::chrono::steady_clock::now();
+			const std::string columns = std::to_string(i) + ";" + std::to_string(run.point) + ";" + std::to_string(run.replicate) + ";" + std::to_string(run.seed) + ";" + run.values;
+			std::ostringstream year_rows;
+			std::unique_ptr<psim> sim_pointer;
+			if (fork) {
+				sim_pointer = std::make_unique<psim>(from, terrain, run.params, run.seed);
+			} else {
+				sim_pointer = std::make_unique<psim>(terrain, cells, size, run.params, run.seed);
+			}
+			psim& sim = *sim_pointer;
+			sim_stats last = sim.stats;
+			int bears_extinct = -1;
+			int seals_extinct = -1;
+			for (int i = 0; i < years; i++) {
+				for (int tick = 0; tick < run.params.ticks_per_year; tick++) {
+					sim.update();
+				}
+				const int year = sim.ticks / run.params.ticks_per_year;
+				const sim_stats& now = sim.stats;
+				year_rows << columns << year << ";" << sim.bears.size() << ";" << sim.seals.size() << ";"
+					<< now.bears.born - last.bears.born << ";" << now.seals.born - last.seals.born << ";"
+					<< now.bears.dead_from_hunger - last.bears.dead_from_hunger << ";" << now.seals.dead_from_hunger - last.seals.dead_from_hunger << ";"
+					<< now.bears.dead_from_age - last.bears.dead_from_age << ";" << now.seals.dead_from_age - last.seals.dead_from_age << ";"
+					<< now.bears.dead_randomly - last.bears.dead_randomly << ";" << now.seals.dead_randomly - last.seals.dead_randomly << ";"
+					<< now.seals_eaten_by_bears - last.seals_eaten_by_bears << ";\n";
+				last = now;
+				if (bears_extinct == -1 && sim.bears.size() == 0) {
+					bears_extinct = year;
+				}
+				if (seals_extinct == -1 && sim.seals.size() == 0) {
+					seals_extinct = year;
+				}
+			}
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start_time).count();
+			std::lock_guard<std::mutex> lock(output_mutex);
+			years_file << year_rows.str();
+			runs_file << columns << years << ";" << sim.bears.size() << ";" << sim.seals.size() << ";"
+				<< (bears_extinct == -1 ? "" : std::to_string(bears_extinct)) << ";"
+				<< (seals_extinct == -1 ? "" : std::to_string(seals_extinct)) << ";" << seconds << ";\n";
+			runs_file.flush();
+			years_file.flush();
+			finished++;
+			if (!quiet) {
+				printf("Run %zu (%i/%zu): %zu bears, %zu seals in %.2f s\n", i, finished, runs.size(), sim.bears.size(), sim.seals.size(), seconds);
+			}
+		}
+	});
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	const double total_years = (double)years * (double)runs.size();
+	printf("Runs: %zu\n", runs.size());
+	printf("Jobs: %i\n", pool.size());
+	printf("Simulated %.0f years in %.3f s (%.2f years/s)\n", total_years, seconds, seconds > 0.0 ? total_years / seconds : 0.0);
+	return 0;
+}
@@ -0,0 +1,219 @@
+#include "terrain.hpp"
+#include "psim.hpp"
+#include "mapped_file.hpp"
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cmath>
+
+#if PSIM_PNG_ENABLED
+#include <png.h>
+#endif
+
+#define TERRAIN_CACHE_MAGIC      "PSTC"
+#define TERRAIN_CACHE_VERSION    1
+#define TERRAIN_CACHE_EXTENSION  ".pstc"
+#define TERRAIN_CACHE_ALIGNMENT  64
+
+// The terrain cache is this header followed by the plane and the cell lists, each starting at a multiple
+// of TERRAIN_CACHE_ALIGNMENT bytes from the start of the file, like a checkpoint.
+struct terrain_cache_header {
+	char magic[4];
+	uint32_t version;
+	int32_t world_size;
+	int32_t padding;
+	uint64_t source_size; // The size and modification time of the world map it was made from.
+	int64_t source_time;
+	uint64_t terrain;     // Offset of the plane, with world_size * world_size bytes.
+	uint64_t ground_count;
+	uint64_t ground;      // Offsets of the cell lists, with int32 values.
+	uint64_t water_count;
+	uint64_t water;
+};
+
+static bool ends_with(const std::string& string, const std::string& suffix) {
+	return string.size() >= suffix.size() && string.compare(string.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool load_raw_terrain(const std::string& path, std::vector<uint32_t>& pixels, int& size) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) {
+		return false;
+	}
+	const size_t length = (size_t)file.tellg();
+	size = (int)std::sqrt((double)length);
+	if (length == 0 || (size_t)size * (size_t)size != length || size > MAX_WORLD_SIZE) {
+		return false;
+	}
+	std::vector<uint8_t> bytes(length);
+	file.seekg(0);
+	file.read((char*)bytes.data(), length);
+	pixels.resize(length);
+	for (size_t i = 0; i < length; i++) {
+		pixels[i] = (bytes[i] == 0 ? WATER : GROUND);
+	}
+	return true;
+}
+
+#if PSIM_PNG_ENABLED
+static bool load_png_terrain(const std::string& path, std::vector<uint32_t>& pixels, int& size) {
+	png_image image = {};
+	image.version = PNG_IMAGE_VERSION;
+	if (!png_image_begin_read_from_file(&image, path.c_str())) {
+		return false;
+	}
+	if (image.width != image.height || image.width > MAX_WORLD_SIZE) {
+		png_image_free(&image);
+		return false;
+	}
+	image.format = PNG_FORMAT_BGRA;
+	size = (int)image.width;
+	pixels.resize((size_t)size * (size_t)size);
+	// BGRA bytes on a little endian machine is the 0xAARRGGBB layout used by the world texture.
+	if (!png_image_finish_read(&image, nullptr, pixels.data(), 0, nullptr)) {
+		png_image_free(&image);
+		return false;
+	}
+	return true;
+}
+#endif
+
+bool load_terrain(const std::string& path, std::vector<uint32_t>& pixels, int& size) {
+	if (ends_with(path, ".raw")) {
+		return load_raw_terrain(path, pixels, size);
+	}
+#if PSIM_PNG_ENABLED
+	return load_png_terrain(path, pixels, size);
+#else
+	return false;
+#endif
+}
+
+terrain_plane make_terrain_plane(const uint32_t* pixels, int size) {
+	auto plane = std::make_shared<std::vector<uint8_t>>((size_t)size * (size_t)size);
+	for (size_t i = 0; i < plane->size(); i++) {
+		(*plane)[i] = (pixels[i] == WATER ? TERRAIN_WATER : TERRAIN_GROUND);
+	}
+	return plane;
+}
+
+terrain_cells make_terrain_cells(const std::vector<uint8_t>& plane) {
+	size_t water_count = 0;
+	for (uint8_t terrain : plane) {
+		water_count += (terrain == TERRAIN_WATER);
+	}
+	terrain_cells cells;
+	cells.ground.reserve(plane.size() - water_count);
+	cells.water.reserve(water_count);
+	for (size_t i = 0; i < plane.size(); i++) {
+		(plane[i] == TERRAIN_WATER ? cells.water : cells.ground).push_back((int)i);
+	}
+	return cells;
+}
+
+static uint64_t align(uint64_t offset) {
+	return (offset + TERRAIN_CACHE_ALIGNMENT - 1) / TERRAIN_CACHE_ALIGNMENT * TERRAIN_CACHE_ALIGNMENT;
+}
+
+// Copies a cell list out of the cache, and checks it on the way. The cells must be in order, inside the world,
+// and of the list's terrain. With the counts adding up to the cell count, the two lists then hold every cell once.
+static bool read_cache_cells(const uint8_t* data, uint64_t count, const uint8_t* terrain, uint64_t cell_count, uint8_t kind, std::vector<int>& cells) {
+	const int32_t* in = (const int32_t*)data;
+	cells.resize((size_t)count);
+	int64_t last = -1;
+	for (size_t i = 0; i < cells.size(); i++) {
+		const int32_t cell_i = in[i];
+		if (cell_i <= last || (uint64_t)cell_i >= cell_count || terrain[cell_i] != kind) {
+			return false;
+		}
+		cells[i] = cell_i;
+		last = cell_i;
+	}
+	return true;
+}
+
+static bool read_terrain_cache(const std::string& path, uint64_t source_size, int64_t source_time, terrain_plane& plane, terrain_cells& cells, int& size) {
+	mapped_file file;
+	if (!file.open(path) || file.size() < sizeof(terrain_cache_header)) {
+		return false;
+	}
+	const terrain_cache_header& header = *(const terrain_cache_header*)file.data();
+	const uint64_t cell_count = (uint64_t)header.world_size * (uint64_t)header.world_size;
+	bool valid = memcmp(header.magic, TERRAIN_CACHE_MAGIC, 4) == 0 && header.version == TERRAIN_CACHE_VERSION;
+	valid = valid && header.source_size == source_size && header.source_time == source_time;
+	valid = valid && header.world_size > 0 && header.world_size <= MAX_WORLD_SIZE;
+	valid = valid && header.ground_count + header.water_count == cell_count && header.terrain + cell_count <= file.size();
+	valid = valid && header.ground + header.ground_count * sizeof(int32_t) <= file.size();
+	valid = valid && header.water + header.water_count * sizeof(int32_t) <= file.size();
+	if (!valid) {
+		return false;
+	}
+	const uint8_t* terrain = file.data() + header.terrain;
+	if (!read_cache_cells(file.data() + header.ground, header.ground_count, terrain, cell_count, TERRAIN_GROUND, cells.ground)
+		|| !read_cache_cells(file.data() + header.water, header.water_count, terrain, cell_count, TERRAIN_WATER, cells.water)) {
+		return false;
+	}
+	size = header.world_size;
+	plane = std::make_shared<const std::vector<uint8_t>>(terrain, terrain + cell_count);
+	return true;
+}
+
+static void write_terrain_cache(const std::string& path, uint64_t source_size, int64_t source_time, const terrain_plane& plane, const terrain_cells& cells, int size) {
+	terrain_cache_header header = {};
+	memcpy(header.magic, TERRAIN_CACHE_MAGIC, 4);
+	header.version = TERRAIN_CACHE_VERSION;
+	header.world_size = size;
+	header.source_size = source_size;
+	header.source_time = source_time;
+	header.terrain = align(sizeof(header));
+	header.ground_count = cells.ground.size();
+	header.ground = align(header.terrain + plane->size());
+	header.water_count = cells.water.size();
+	header.water = align(header.ground + header.ground_count * sizeof(int32_t));
+
+	const std::string partial_path = path + ".part";
+	std::ofstream file(partial_path, std::ios::binary);
+	auto write_at = [&](uint64_t offset, const void* data, size_t size) {
+		static const char padding[TERRAIN_CACHE_ALIGNMENT] = {};
+		if (!file) {
+			return;
+		}
+		const uint64_t position = (uint64_t)file.tellp();
+		file.write(padding, offset - position);
+		file.write((const char*)data, size);
+	};
+	write_at(0, &header, sizeof(header));
+	write_at(header.terrain, plane->data(), plane->size());
+	write_at(header.ground, cells.ground.data(), cells.ground.size() * sizeof(int32_t));
+	write_at(header.water, cells.water.data(), cells.water.size() * sizeof(int32_t));
+	file.close();
+	std::error_code error;
+	if (file) {
+		std::filesystem::rename(partial_path, path, error);
+	}
+	if (!file || error) {
+		std::filesystem::remove(partial_path, error);
+	}
+}
+
+bool load_cached_terrain(const std::string& path, terrain_plane& plane, terrain_cells& cells, int& size) {
+	std::error_code error;
+	const uint64_t source_size = (uint64_t)std::filesystem::file_size(path, error);
+	if (error) {
+		return false;
+	}
+	const int64_t source_time = (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+	const std::string cache_path = path + TERRAIN_CACHE_EXTENSION;
+	if (read_terrain_cache(cache_path, source_size, source_time, plane, cells, size)) {
+		return true;
+	}
+	std::vector<uint32_t> pixels;
+	if (!load_terrain(path, pixels, size)) {
+		return false;
+	}
+	plane = make_terrain_plane(pixels.data(), size);
+	pixels = {};
+	cells = make_terrain_cells(*plane);
+	write_terrain_cache(cache_path, source_size, source_time, plane, cells, size);
+	return true;
+}
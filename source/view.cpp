@@ -0,0 +1,354 @@
+#include <GLEW/glew.h>
+
+#include "view.hpp"
+#include "assets.hpp"
+#include <engine.hpp>
+#include <camera.hpp>
+#include <ctime>
+#include <algorithm>
+#include <cmath>
+
+psim_view::psim_view(psim& sim) : sim(sim), runner(sim) {
+	// The pixels are only kept until the texture is made. Later uploads compose the changed tiles in a buffer of their own.
+	ani.create();
+	ani.pixels = new uint32[(size_t)sim.world_size * (size_t)sim.world_size];
+	ani.size = sim.world_size;
+	for (size_t i = 0; i < (size_t)sim.world_size * (size_t)sim.world_size; i++) {
+		ani.pixels[i] = sim.pixel((int)i);
+	}
+	ani.parameters.are_pixels_in_memory = false;
+	ani.render();
+	for (int level = 0; level < DENSITY_LEVELS; level++) {
+		const int per_row = runner.front().density.level(level).per_row;
+		overview[level].create();
+		overview[level].pixels = new uint32[(size_t)per_row * (size_t)per_row]();
+		overview[level].size = per_row;
+		overview[level].parameters.are_pixels_in_memory = false;
+		overview[level].render();
+	}
+	stale[0].resize(sim.dirty_tiles.size(), 0);
+	for (int level = 0; level < DENSITY_LEVELS; level++) {
+		stale[level + 1].resize(sim.dirty_tiles.size(), 1);
+	}
+	if (GLEW_ARB_pixel_buffer_object && GLEW_ARB_map_buffer_range) {
+		glGenBuffers(1, &pixel_buffer);
+	}
+	runner.set_rate(SIM_TICKS_PER_SECOND);
+	runner.set_running(SIM_AUTO);
+
+	ne::listen([&](ne::keyboard_key_message key) {
+		if (key.is_pressed && !playing) {
+			if (key.key == KEY_B) {
+				follow(ANIMAL_BEAR, ne::random_int((int)runner.front().bears - 1));
+			} else if (key.key == KEY_N) {
+				follow(ANIMAL_SEAL, ne::random_int((int)runner.front().seals - 1));
+			}
+		}
+	});
+	// Starts or stops writing births and deaths. Convert the log to CSV with psim_events.
+	ne::listen([&](ne::keyboard_key_message key) {
+		if (key.is_pressed && key.key == KEY_0) {
+			runner.paused([&] {
+				if (this->sim.events.is_open()) {
+					this->sim.close_event_log();
+				} else {
+					const time_t t = time(nullptr) - 1520561000;
+					this->sim.open_event_log(STRING("stats/events_" << t << ".psev"));
+				}
+			});
+		}
+	});
+	ne::listen([&](ne::keyboard_key_message key) {
+		if (!key.is_pressed) {
+			return;
+		}
+		if (key.key == KEY_O) {
+			// Starts or stops recording a replay.
+			runner.paused([&] {
+				if (this->sim.replay.is_open()) {
+					this->sim.close_replay();
+				} else {
+					const time_t t = time(nullptr) - 1520561000;
+					this->sim.open_replay(STRING("stats/" << t << ".psrp"));
+				}
+			});
+		} else if (key.key == KEY_C && !playing) {
+			// Saves the simulation, to be continued with SIM_RESUME or psim_cli.
+			const time_t t = time(nullptr) - 1520561000;
+			runner.paused([&] {
+				checkpoints.save(this->sim, STRING("stats/" << t << ".pscp"));
+			});
+		} else if (key.key == KEY_T) {
+			// Writes the profiled zones of the last few thousand ticks. Open it in chrome://tracing or Perfetto.
+			const time_t t = time(nullptr) - 1520561000;
+			get_profiler().write_chrome_trace(STRING("stats/" << t << ".trace.json"));
+		} else if (key.key == KEY_P) {
+			if (!playing) {
+				// The simulation stops for good, since its world is replaced.
+				runner.set_running(false);
+				playing = load_replay(LOAD_REPLAY);
+			}
+		} else if (playing && key.key == KEY_J) {
+			seek_replay_year(this->sim.year - 1);
+		} else if (playing && key.key == KEY_K) {
+			seek_replay_year(this->sim.year + 1);
+		}
+	});
+}
+
+psim_view::~psim_view() {
+	if (pixel_buffer != 0) {
+		glDeleteBuffers(1, &pixel_buffer);
+	}
+}
+
+void psim_view::update() {
+	if (!playing) {
+#if !SIM_AUTO
+		runner.set_running(ne::is_key_down(KEY_SPACE));
+#endif
+		return;
+	}
+#if !SIM_AUTO
+	if (!ne::is_key_down(KEY_SPACE)) {
+		return;
+	}
+#endif
+	// The runner is stopped while playing, so the replay is written straight into the simulation and handed over from here.
+	std::vector<uint64_t> changed;
+	if (!replay.next(sim.occupants, changed)) {
+		NE_WARNING_LIMIT("No more ticks in recording.", 1);
+		return;
+	}
+	for (uint64_t cell : changed) {
+		const int x = (int)(cell % sim.world_size);
+		const int y = (int)(cell / sim.world_size);
+		sim.dirty_tiles[x / DIRTY_TILE_SIZE + y / DIRTY_TILE_SIZE * sim.dirty_tiles_per_row] = 1;
+	}
+	sim.ticks = replay.tick();
+	sim.year = sim.ticks / replay.ticks_per_year;
+	runner.publish();
+}
+
+void psim_view::follow(uint8_t animal, int ref_i) {
+	bb.animal = animal;
+	bb.ref_i = ref_i;
+	runner.follow(animal, ref_i);
+}
+
+// Shows the replay instead of the simulation. The simulation stops, and its world is replaced by the replay's.
+bool psim_view::load_replay(const std::string& path) {
+	if (!replay.open(path) || replay.world_size != sim.world_size) {
+		return false;
+	}
+	sim.terrain = std::make_shared<const std::vector<uint8_t>>(replay.terrain);
+	sim.world = sim.terrain->data();
+	sim.params.ticks_per_year = replay.ticks_per_year;
+	follow(ANIMAL_NONE, -1);
+	return seek_replay_year(0);
+}
+
+bool psim_view::seek_replay_year(int year) {
+	const int tick = std::min(std::max(year * replay.ticks_per_year, replay.first_tick()), replay.last_tick());
+	if (!replay.seek(tick, sim.occupants)) {
+		return false;
+	}
+	std::fill(sim.dirty_tiles.begin(), sim.dirty_tiles.end(), 1);
+	sim.ticks = replay.tick();
+	sim.year = sim.ticks / replay.ticks_per_year;
+	runner.publish();
+	return true;
+}
+
+int psim_view::overview_level() const {
+#if SIM_OVERVIEW
+	const float cells_per_pixel = ne::ortho_camera::bound()->size().x / (float)ne::window_size().x;
+	int level = -1;
+	while (level + 1 < DENSITY_LEVELS && (float)DENSITY_BLOCK_SIZE(level + 1) <= cells_per_pixel) {
+		level++;
+	}
+	return level;
+#else
+	return -1;
+#endif
+}
+
+// Recomposes and uploads only the tiles that changed and are in view, with a texel per cell for the world,
+// and per block for an overview. Adjacent stale tiles in a row are merged into one rectangle. With a pixel buffer,
+// the pixels are written straight into an orphaned buffer, so the driver can upload it without stalling the frame.
+int psim_view::upload_dirty_tiles(int level) {
+	PROFILE_SCOPE(ZONE_UPLOAD);
+	runner.set_density(level >= 0);
+	if (runner.acquire()) {
+		const std::vector<uint8_t>& changed = runner.changed();
+		for (auto& tiles : stale) {
+			for (size_t i = 0; i < tiles.size(); i++) {
+				tiles[i] |= changed[i];
+			}
+		}
+	}
+	const sim_snapshot& snapshot = runner.front();
+	if (!snapshot.density_counted) {
+		level = -1;
+	}
+	(level < 0 ? ani : overview[level]).bind();
+
+	// The names PIXEL_AT expects, read from the snapshot.
+	const uint8_t* occupants = snapshot.occupants.data();
+	const uint8_t* world = sim.world;
+	const int texel = (level < 0 ? 1 : DENSITY_BLOCK_SIZE(level));
+	const int texels_per_row = (level < 0 ? sim.world_size : snapshot.density.level(level).per_row);
+	auto texel_pixel = [&](int x, int y) {
+		return level < 0 ? PIXEL_AT(x + y * sim.world_size) : snapshot.density.pixel(level, x + y * texels_per_row);
+	};
+
+	// Tiles are taken in square groups that cover whole texels, starting from the first group in view.
+	std::vector<uint8_t>& dirty_tiles = stale[level + 1];
+	const int per_row = sim.dirty_tiles_per_row;
+	const int group = std::max(1, texel / DIRTY_TILE_SIZE);
+	const ne::vector2f view_position = ne::ortho_camera::bound()->xy();
+	const ne::vector2f view_size = ne::ortho_camera::bound()->size();
+	auto first_tile = [&](float cell) {
+		return std::clamp((int)std::floor(cell / (float)DIRTY_TILE_SIZE), 0, per_row) / group * group;
+	};
+	auto end_tile = [&](float cell) {
+		return std::clamp((int)std::ceil(cell / (float)DIRTY_TILE_SIZE), 0, per_row);
+	};
+	// Takes the group at the tile, and returns whether any of it was stale.
+	auto take_group = [&](int tile_x, int tile_y) {
+		bool taken = false;
+		for (int y = tile_y; y < std::min(tile_y + group, per_row); y++) {
+			for (int x = tile_x; x < std::min(tile_x + group, per_row); x++) {
+				taken |= (dirty_tiles[x + y * per_row] != 0);
+				dirty_tiles[x + y * per_row] = 0;
+			}
+		}
+		return taken;
+	};
+	struct rectangle {
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+	};
+	std::vector<rectangle> rectangles;
+	size_t total_pixels = 0;
+	const int end_x = end_tile(view_position.x + view_size.x);
+	const int end_y = end_tile(view_position.y + view_size.y);
+	for (int tile_y = first_tile(view_position.y); tile_y < end_y; tile_y += group) {
+		int tile_x = first_tile(view_position.x);
+		while (tile_x < end_x) {
+			if (!take_group(tile_x, tile_y)) {
+				tile_x += group;
+				continue;
+			}
+			rectangle rect;
+			rect.x = tile_x * DIRTY_TILE_SIZE / texel;
+			rect.y = tile_y * DIRTY_TILE_SIZE / texel;
+			tile_x += group;
+			while (tile_x < end_x && take_group(tile_x, tile_y)) {
+				tile_x += group;
+			}
+			rect.width = (std::min(tile_x * DIRTY_TILE_SIZE, sim.world_size) + texel - 1) / texel - rect.x;
+			rect.height = (std::min((tile_y + group) * DIRTY_TILE_SIZE, sim.world_size) + texel - 1) / texel - rect.y;
+			rectangles.push_back(rect);
+			total_pixels += rect.width * rect.height;
+		}
+	}
+	if (rectangles.empty()) {
+		return level;
+	}
+	// The pixels are 0xAARRGGBB, which is BGRA in memory.
+	if (pixel_buffer != 0) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, total_pixels * sizeof(uint32), nullptr, GL_STREAM_DRAW);
+		uint32* mapped = (uint32*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total_pixels * sizeof(uint32), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (mapped) {
+			uint32* out = mapped;
+			for (auto& rect : rectangles) {
+				for (int y = rect.y; y < rect.y + rect.height; y++) {
+					for (int x = rect.x; x < rect.x + rect.width; x++) {
+						*out++ = texel_pixel(x, y);
+					}
+				}
+			}
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			size_t offset = 0;
+			for (auto& rect : rectangles) {
+				glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height, GL_BGRA, GL_UNSIGNED_BYTE, (const void*)(offset * sizeof(uint32)));
+				offset += rect.width * rect.height;
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return level;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	std::vector<uint32> pixels(total_pixels);
+	size_t offset = 0;
+	for (auto& rect : rectangles) {
+		uint32* out = pixels.data() + offset;
+		for (int y = rect.y; y < rect.y + rect.height; y++) {
+			for (int x = rect.x; x < rect.x + rect.width; x++) {
+				*out++ = texel_pixel(x, y);
+			}
+		}
+		glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height, GL_BGRA, GL_UNSIGNED_BYTE, pixels.data() + offset);
+		offset += rect.width * rect.height;
+	}
+	return level;
+}
+
+void psim_view::draw() {
+	PROFILE_SCOPE(ZONE_DRAW);
+	ne::shader::set_color(1.0f);
+	const int level = upload_dirty_tiles(overview_level());
+	ne::transform3f transform;
+	if (level < 0) {
+		transform.scale.xy = ani.size.to<float>();
+	} else {
+		// Blocks cut off by the edge of the world are drawn whole, a little past it.
+		transform.scale.xy = (float)(overview[level].size.x * DENSITY_BLOCK_SIZE(level));
+	}
+	ne::shader::set_transform(&transform);
+	ne::drawing_shape::bound()->draw();
+	const sim_snapshot& snapshot = runner.front();
+	if (!playing && bb.animal != ANIMAL_NONE) {
+		const followed_animal& followed = snapshot.followed;
+		if (followed.animal != bb.animal || followed.slot != bb.ref_i) {
+			return; // Picked out after the snapshot was taken.
+		}
+		if (!followed.found || snapshot.occupants[followed.cell] == ANIMAL_NONE) {
+			follow(ANIMAL_NONE, -1);
+			return;
+		}
+		int cell_i = followed.cell;
+		textures.blank.bind();
+		ne::shader::set_color({ 1.0f, 0.0f, 1.0f, 1.0f });
+		bb.transform.position.x = (float)(cell_i % sim.world_size);
+		bb.transform.position.y = (float)(cell_i / sim.world_size);
+		bb.transform.scale.xy = 1.0f;
+		ne::shader::set_transform(&bb.transform);
+		ne::drawing_shape::bound()->draw();
+		ne::ortho_camera::bound()->target = &bb.transform;
+		bb.info.font = &fonts.debug;
+		bool rendered = bb.info.render(STRING(
+			"Hunger: " << (int)(followed.hunger * 100.0f) <<
+			"\nAge: " << (int)followed.age
+		));
+		bb.info.transform.position = bb.transform.position;
+		if (rendered) {
+			bb.info.transform.scale.x /= 4.0f;
+			bb.info.transform.scale.y /= 4.0f;
+		}
+		bb.info.transform.position.x -= bb.info.transform.scale.width / 2.0f;
+		bb.info.transform.position.y -= bb.info.transform.scale.height;
+		ne::shader::set_color({ 0.0f, 0.0f, 0.0f, 1.0f });
+		bb.info.draw();
+		bb.info.transform.position.x -= 0.25f;
+		bb.info.transform.position.y -= 0.25f;
+		ne::shader::set_color({ 1.0f, 0.0f, 1.0f, 1.0f });
+		bb.info.draw();
+	} else {
+		ne::ortho_camera::bound()->target = nullptr;
+	}
+}
@@ -0,0 +1,61 @@
+#include "workers.hpp"
+
+worker_pool::worker_pool(int count) {
+	for (int i = 1; i < count; i++) {
+		threads.emplace_back(&worker_pool::work, this, i);
+	}
+}
+
+worker_pool::~worker_pool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	start_condition.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+void worker_pool::run(const std::function<void(int)>& job) {
+	if (threads.empty()) {
+		job(0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->job = &job;
+		busy = (int)threads.size();
+		generation++;
+	}
+	start_condition.notify_all();
+	job(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	done_condition.wait(lock, [this] {
+		return busy == 0;
+	});
+	this->job = nullptr;
+}
+
+void worker_pool::work(int worker) {
+	unsigned long long last_generation = 0;
+	while (true) {
+		const std::function<void(int)>* current_job = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start_condition.wait(lock, [&] {
+				return stopping || generation != last_generation;
+			});
+			if (stopping) {
+				return;
+			}
+			last_generation = generation;
+			current_job = job;
+		}
+		(*current_job)(worker);
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0) {
+			done_condition.notify_one();
+		}
+	}
+}